@@ -4,12 +4,57 @@
 * To use this library, just include it in one C or C++ file:
 * #include "fix_arena.h"
 *
+* The scratch arenas are the only part with storage of their own. If you use them, define FIX_ARENA_IMPL in ONE file:
+* #define FIX_ARENA_IMPL
+* #include "fix_arena.h"
+*
 * Arena Allocator
 *
 * NOTES:
 * All functions are declared `static inline` since they don't do anything complex
 * The arena currently calls `malloc`, but only during `init`. This will likely be changed to take in a pre-existing buffer
 * `free` exists to provide parity for anything that requires malloc and free to be redefined together, but does nothing
+*
+* `fix_arena_malloc` doesn't align anything. Use `fix_arena_malloc_aligned` or the `fix_arena_push_*` macros
+* when the memory will hold anything other than bytes (floats, vectors, pixels...)
+*
+* `fix_arena_realloc` grows or shrinks the most recent allocation in place and only copies when something was allocated after it.
+* `fix_arena_array(T)` is a growable array built on top of it: as long as nothing else is allocated in between, it grows without copying.
+*
+* Markers (`fix_arena_save` / `fix_arena_restore`) pop scratch allocations in LIFO order without clearing the whole arena.
+*
+* Define FIX_ARENA_DEBUG to harden `fix_arena` (and the scratch and chained arenas built on it). Failed checks trip
+* FIX_ARENA_ASSERT (default `assert`): markers restored out of order, pointers passed to `fix_arena_free` that the arena
+* never handed out, and writes past the end of the most recent allocation, caught by FIX_ARENA_DEBUG_GUARD_SIZE guard bytes
+* placed after it and checked on the next allocation. Memory given back by `free_all` and `restore` is filled with 0xDD.
+* When compiled with AddressSanitizer, unallocated memory is poisoned instead, so ASan reports the bad access itself.
+* Call `destroy` on arenas over stack buffers then, so the stack isn't left poisoned.
+*
+* Every thread gets FIX_ARENA_SCRATCH_COUNT (default 2) scratch arenas of FIX_ARENA_SCRATCH_SIZE bytes, malloc'ed on first use.
+* `fix_arena_scratch_begin` takes the arenas the caller is already allocating into, so the temporaries never land in them.
+* Call `fix_arena_scratch_release` before a thread exits to give the memory back. The scratch arenas are shared by the whole
+* program, so FIX_ARENA_SCRATCH_COUNT has to be the same in every file that includes fix_arena.h.
+*
+* `fix_arena_atomic` is a thread-safe arena that many threads can append into at once. Space is reserved with
+* a compare-and-swap on the shared offset that only ever publishes an offset that fits, so failed allocations leave
+* the arena untouched. Threads can carve private chunks out of it with `fix_arena_atomic_reserve` to keep contention
+* on the shared counter down. The atomics use the GCC/Clang `__atomic` builtins, define FIX_ARENA_ATOMIC_LOAD and
+* FIX_ARENA_ATOMIC_CAS to provide your own. On other compilers the atomic arena only exists if you do.
+*
+* Define FIX_ARENA_VM to get `fix_arena_vm` (Linux only). It reserves a large address range with `mmap` up front,
+* commits pages in FIX_ARENA_VM_COMMIT_SIZE steps as the offset grows and gives pages above its high-water mark back
+* to the OS on `free_all`. Sizes are `size_t`, so it isn't capped at 4 GiB, and untouched memory costs no RSS.
+* With a strict `-std=c99/c11`, define _DEFAULT_SOURCE before any include so `sys/mman.h` exposes MAP_ANONYMOUS and madvise.
+*
+* Define FIX_ARENA_STATS to track the peak offset, allocation count, failed allocations and bytes lost to alignment
+* of every `fix_arena`. `fix_arena_tag_here` / `fix_arena_set_tag` attribute the following allocations to a call site,
+* `fix_arena_stats_dump` prints it all. Without FIX_ARENA_STATS the tagging macros compile to nothing.
+* Chained arenas keep their statistics across blocks: moving on to a new block isn't a failed allocation,
+* and `fix_arena_chain_stats_dump` reports the size and peak of all blocks together.
+*
+* Chained arenas (`fix_arena_chain`) link new blocks with `FIX_ARENA_MALLOC` when the current one runs out,
+* instead of returning NULL. `fix_arena_chain_free_all` keeps only the largest block around, so a workload
+* that allocates roughly the same amount every frame stops hitting the system allocator after a few frames.
 */
 
 #ifndef FIX_ARENA_H
@@ -28,28 +73,277 @@ extern "C"{
 #include <string.h>
 #define FIX_ARENA_MEMSET memset
 #endif
+#ifndef FIX_ARENA_MEMCPY
+#include <string.h>
+#define FIX_ARENA_MEMCPY memcpy
+#endif //FIX_ARENA_MEMCPY
+
+//Needed for uintptr_t, alignment is applied to the actual address rather than the offset
+#include <stdint.h>
+
+#ifdef FIX_ARENA_DEBUG
+#ifndef FIX_ARENA_ASSERT
+#include <assert.h>
+#define FIX_ARENA_ASSERT assert
+#endif //FIX_ARENA_ASSERT
+#ifndef FIX_ARENA_DEBUG_GUARD_SIZE
+#define FIX_ARENA_DEBUG_GUARD_SIZE 8
+#endif //FIX_ARENA_DEBUG_GUARD_SIZE
+#define FIX_ARENA_DEBUG_GUARD_BYTE 0xFD
+#define FIX_ARENA_DEBUG_POISON_BYTE 0xDD
+
+#if defined(__SANITIZE_ADDRESS__)
+#define FIX_ARENA_ASAN
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define FIX_ARENA_ASAN
+#endif
+#endif
+#endif //FIX_ARENA_DEBUG
+
+#ifdef FIX_ARENA_ASAN
+#include <sanitizer/asan_interface.h>
+#define FIX_ARENA_ASAN_POISON(addr, size) ASAN_POISON_MEMORY_REGION((addr), (size))
+#define FIX_ARENA_ASAN_UNPOISON(addr, size) ASAN_UNPOISON_MEMORY_REGION((addr), (size))
+#else
+#define FIX_ARENA_ASAN_POISON(addr, size) ((void)0)
+#define FIX_ARENA_ASAN_UNPOISON(addr, size) ((void)0)
+#endif //FIX_ARENA_ASAN
+
+#ifdef FIX_ARENA_STATS
+#include <stdio.h>
+#ifndef FIX_ARENA_STATS_TAG_MAX
+#define FIX_ARENA_STATS_TAG_MAX 32
+#endif //FIX_ARENA_STATS_TAG_MAX
+#endif //FIX_ARENA_STATS
+
+#ifndef FIX_ARENA_THREAD_LOCAL
+#if defined(__cplusplus)
+#define FIX_ARENA_THREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+#define FIX_ARENA_THREAD_LOCAL __declspec(thread)
+#else
+#define FIX_ARENA_THREAD_LOCAL _Thread_local
+#endif
+#endif //FIX_ARENA_THREAD_LOCAL
+
+#if defined(__GNUC__) || defined(__clang__)
+#ifndef FIX_ARENA_ATOMIC_LOAD
+#define FIX_ARENA_ATOMIC_LOAD(ptr) __atomic_load_n(ptr, __ATOMIC_RELAXED)
+#endif //FIX_ARENA_ATOMIC_LOAD
+#ifndef FIX_ARENA_ATOMIC_CAS
+//Weak compare-and-swap, evaluates to nonzero on success. On failure `*expected` is updated to the current value.
+#define FIX_ARENA_ATOMIC_CAS(ptr, expected, desired) __atomic_compare_exchange_n(ptr, expected, desired, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#endif //FIX_ARENA_ATOMIC_CAS
+#endif //__GNUC__ || __clang__
+
+#ifdef FIX_ARENA_VM
+#include <stddef.h>
+#include <sys/mman.h>
+#ifndef FIX_ARENA_VM_COMMIT_SIZE
+#define FIX_ARENA_VM_COMMIT_SIZE (64 * 1024) //Has to be a multiple of the page size
+#endif //FIX_ARENA_VM_COMMIT_SIZE
+#endif //FIX_ARENA_VM
+
+#ifndef FIX_ARENA_SCRATCH_SIZE
+#define FIX_ARENA_SCRATCH_SIZE (1024 * 1024)
+#endif //FIX_ARENA_SCRATCH_SIZE
+
+#ifndef FIX_ARENA_SCRATCH_COUNT
+#define FIX_ARENA_SCRATCH_COUNT 2
+#endif //FIX_ARENA_SCRATCH_COUNT
+
+#ifndef FIX_ARENA_ALIGNOF
+#ifdef __cplusplus
+#define FIX_ARENA_ALIGNOF(T) alignof(T)
+#else
+#define FIX_ARENA_ALIGNOF(T) _Alignof(T)
+#endif //__cplusplus
+#endif //FIX_ARENA_ALIGNOF
+
+#ifdef FIX_ARENA_STATS
+struct fix_arena_stats_tag_s
+{
+	const char *tag;
+	unsigned int count;
+	unsigned long long bytes;
+};
+typedef struct fix_arena_stats_tag_s fix_arena_stats_tag;
+
+struct fix_arena_stats_s
+{
+	unsigned int peak_offset;
+	unsigned int alloc_count;
+	unsigned int failed_count;
+	unsigned long long alloc_bytes;
+	unsigned long long alignment_waste;
+	const char *current_tag; //Tag given to the following allocations, NULL when untagged
+	unsigned int tag_count;
+	fix_arena_stats_tag tags[FIX_ARENA_STATS_TAG_MAX];
+};
+typedef struct fix_arena_stats_s fix_arena_stats;
+#endif //FIX_ARENA_STATS
 
 struct fix_arena_s
 {
 	unsigned char *memory;
 	unsigned int size;
 	unsigned int offset;
+#ifdef FIX_ARENA_DEBUG
+	unsigned int marker_depth; //How many markers are currently saved
+	unsigned int guarded; //The guard bytes right at `offset` are in place
+#endif //FIX_ARENA_DEBUG
+#ifdef FIX_ARENA_STATS
+	fix_arena_stats stats;
+#endif //FIX_ARENA_STATS
 };
 typedef struct fix_arena_s fix_arena;
 
+#define FIX_ARENA_STRINGIFY_(x) #x
+#define FIX_ARENA_STRINGIFY(x) FIX_ARENA_STRINGIFY_(x)
+
+#ifdef FIX_ARENA_STATS
+//Clears all gathered statistics of the arena
+static inline void fix_arena_stats_reset(fix_arena *arena)
+{
+	FIX_ARENA_MEMSET(&arena->stats, 0, sizeof(arena->stats));
+}
+
+//Tags all following allocations from the arena with `tag` (which has to outlive the arena), NULL to stop tagging
+static inline void fix_arena_set_tag(fix_arena *arena, const char *tag)
+{
+	arena->stats.current_tag = tag;
+}
+
+static inline void fix_arena_stats_alloc(fix_arena *arena, unsigned int size, unsigned int waste)
+{
+	fix_arena_stats *stats = &arena->stats;
+	stats->alloc_count += 1;
+	stats->alloc_bytes += size;
+	stats->alignment_waste += waste;
+	if(arena->offset > stats->peak_offset) stats->peak_offset = arena->offset;
+	if(!stats->current_tag) return;
+
+	//Tags are compared by pointer, string literals from the same call site are the same pointer
+	unsigned int i = 0;
+	while(i < stats->tag_count && stats->tags[i].tag != stats->current_tag) ++i;
+	if(i == stats->tag_count)
+	{
+		if(stats->tag_count == FIX_ARENA_STATS_TAG_MAX) return;
+		stats->tags[i].tag = stats->current_tag;
+		stats->tags[i].count = 0;
+		stats->tags[i].bytes = 0;
+		stats->tag_count += 1;
+	}
+	stats->tags[i].count += 1;
+	stats->tags[i].bytes += size;
+}
+
+//Prints the allocation counts and every tag to `out`
+static inline void fix_arena_stats_dump_allocations(fix_arena_stats *stats, FILE *out)
+{
+	fprintf(out, "  allocations %u (%llu bytes), failed %u, alignment waste %llu bytes\n",
+		stats->alloc_count, stats->alloc_bytes, stats->failed_count, stats->alignment_waste);
+	for(unsigned int i = 0; i < stats->tag_count; ++i)
+	{
+		fprintf(out, "  %s: %u allocations, %llu bytes\n", stats->tags[i].tag, stats->tags[i].count, stats->tags[i].bytes);
+	}
+}
+
+//Prints the arena's statistics and every tag to `out`
+static inline void fix_arena_stats_dump(fix_arena *arena, FILE *out)
+{
+	fix_arena_stats *stats = &arena->stats;
+	fprintf(out, "fix_arena %p: size %u, offset %u, peak %u (%.1f%%)\n", (void *)arena, arena->size, arena->offset,
+		stats->peak_offset, arena->size ? 100.0 * stats->peak_offset / arena->size : 0.0);
+	fix_arena_stats_dump_allocations(stats, out);
+}
+
+#define FIX_ARENA_STATS_ALLOC(arena, size, waste) fix_arena_stats_alloc(arena, size, waste)
+#define FIX_ARENA_STATS_FAIL(arena) ((arena)->stats.failed_count += 1)
+#define FIX_ARENA_STATS_RESET(arena) fix_arena_stats_reset(arena)
+#else
+#define fix_arena_set_tag(arena, tag) ((void)0)
+#define FIX_ARENA_STATS_ALLOC(arena, size, waste) ((void)0)
+#define FIX_ARENA_STATS_FAIL(arena) ((void)0)
+#define FIX_ARENA_STATS_RESET(arena) ((void)0)
+#endif //FIX_ARENA_STATS
+
+//Tags all following allocations from the arena with the current file and line
+#define fix_arena_tag_here(arena) fix_arena_set_tag(arena, __FILE__ ":" FIX_ARENA_STRINGIFY(__LINE__))
+
+#ifdef FIX_ARENA_DEBUG
+//Asserts that nothing wrote past the end of the most recent allocation
+static inline void fix_arena_debug_check(fix_arena *arena)
+{
+	if(!arena->guarded) return;
+	for(unsigned int i = 0; i < FIX_ARENA_DEBUG_GUARD_SIZE; ++i)
+	{
+		FIX_ARENA_ASSERT(arena->memory[arena->offset + i] == FIX_ARENA_DEBUG_GUARD_BYTE && "fix_arena: write past the end of the last allocation");
+	}
+}
+
+//Marks `size` bytes at `mem` as allocated, and guards the memory after them
+static inline void fix_arena_debug_alloc(fix_arena *arena, void *mem, unsigned int size)
+{
+	(void)arena;
+	(void)mem;
+	(void)size;
+	FIX_ARENA_ASAN_UNPOISON(mem, size);
+#ifndef FIX_ARENA_ASAN
+	arena->guarded = FIX_ARENA_DEBUG_GUARD_SIZE <= arena->size - arena->offset;
+	if(arena->guarded) FIX_ARENA_MEMSET(&arena->memory[arena->offset], FIX_ARENA_DEBUG_GUARD_BYTE, FIX_ARENA_DEBUG_GUARD_SIZE);
+#endif //FIX_ARENA_ASAN
+}
+
+//Fills memory given back to the arena, so reads through stale pointers stand out
+static inline void fix_arena_debug_poison(fix_arena *arena, unsigned int from, unsigned int to)
+{
+	arena->guarded = 0;
+	FIX_ARENA_ASAN_UNPOISON(&arena->memory[from], to - from);
+	FIX_ARENA_MEMSET(&arena->memory[from], FIX_ARENA_DEBUG_POISON_BYTE, to - from);
+	FIX_ARENA_ASAN_POISON(&arena->memory[from], to - from);
+}
+
+#define FIX_ARENA_DEBUG_RESET(arena) ((arena)->marker_depth = 0, (arena)->guarded = 0)
+#define FIX_ARENA_DEBUG_CHECK(arena) fix_arena_debug_check(arena)
+#define FIX_ARENA_DEBUG_ALLOC(arena, mem, size) fix_arena_debug_alloc(arena, mem, size)
+#define FIX_ARENA_DEBUG_POISON(arena, from, to) fix_arena_debug_poison(arena, from, to)
+#else
+#define FIX_ARENA_DEBUG_RESET(arena) ((void)0)
+#define FIX_ARENA_DEBUG_CHECK(arena) ((void)0)
+#define FIX_ARENA_DEBUG_ALLOC(arena, mem, size) ((void)0)
+#define FIX_ARENA_DEBUG_POISON(arena, from, to) ((void)0)
+#endif //FIX_ARENA_DEBUG
+
+//Position within an arena that can be returned to later
+struct fix_arena_marker_s
+{
+	unsigned int offset;
+#ifdef FIX_ARENA_DEBUG
+	unsigned int depth;
+#endif //FIX_ARENA_DEBUG
+};
+typedef struct fix_arena_marker_s fix_arena_marker;
+
 //Mallocs a chunk of memory and sets it as the arena's memory
 static inline void fix_arena_init(fix_arena *arena, unsigned int size, unsigned char *buffer)
 {
 	arena->memory = buffer;
 	arena->size = size;
 	arena->offset = 0;
+	FIX_ARENA_DEBUG_RESET(arena);
+	FIX_ARENA_ASAN_POISON(buffer, size);
+	FIX_ARENA_STATS_RESET(arena);
 }
 
 //Sets all arena info to zero, doesn't destroy the memory
 static inline void fix_arena_destroy(fix_arena *arena)
 {
+	FIX_ARENA_ASAN_UNPOISON(arena->memory, arena->size);
 	arena->size = 0;
 	arena->offset = 0;
+	FIX_ARENA_DEBUG_RESET(arena);
 }
 
 //Mallocs a chunk of memory and sets it as the arena's memory
@@ -58,36 +352,141 @@ static inline void fix_arena_malloc_init(fix_arena *arena, unsigned int size)
 	arena->memory = (unsigned char *)FIX_ARENA_MALLOC(size);
 	arena->size = size;
 	arena->offset = 0;
+	FIX_ARENA_DEBUG_RESET(arena);
+	FIX_ARENA_ASAN_POISON(arena->memory, size);
+	FIX_ARENA_STATS_RESET(arena);
 }
 
 //Frees the malloc'ed memory, and sets all arena info to zero
 static inline void fix_arena_free_destroy(fix_arena *arena)
 {
+	FIX_ARENA_ASAN_UNPOISON(arena->memory, arena->size);
 	FIX_ARENA_FREE(arena->memory);
 	arena->size = 0;
 	arena->offset = 0;
+	FIX_ARENA_DEBUG_RESET(arena);
 }
 
 //Zeroes-out the memory, returns the offset to the start of the memory
 static inline void fix_arena_zero(fix_arena *arena)
 {
+	FIX_ARENA_ASAN_UNPOISON(arena->memory, arena->size);
 	FIX_ARENA_MEMSET(arena->memory, 0, arena->size);
+	FIX_ARENA_ASAN_POISON(arena->memory, arena->size);
 	arena->offset = 0;
+	FIX_ARENA_DEBUG_RESET(arena);
+}
+
+//Whether `size` bytes aligned to `align` would still fit in the arena
+static inline int fix_arena_fits(fix_arena *arena, unsigned int size, unsigned int align)
+{
+	uintptr_t address = (uintptr_t)arena->memory + arena->offset;
+	unsigned int padding = (unsigned int)(-address & (uintptr_t)(align - 1));
+	return padding <= arena->size - arena->offset && size <= arena->size - arena->offset - padding;
 }
 
 //allocates memory within the arena. If there's not enough memory within the arena, NULL is returned.
 static inline void *fix_arena_malloc(fix_arena *arena, unsigned int size)
 {
-	if(size + arena->offset > arena->size) return NULL; //We can't allocate that much
+	FIX_ARENA_DEBUG_CHECK(arena);
+	if(size + arena->offset > arena->size) {FIX_ARENA_STATS_FAIL(arena); return NULL;} //We can't allocate that much
 
 	void *mem = &arena->memory[arena->offset];
 	arena->offset += size;
+	FIX_ARENA_DEBUG_ALLOC(arena, mem, size);
+	FIX_ARENA_STATS_ALLOC(arena, size, 0);
 	return mem;
 }
 
-//Does nothing
+//Allocates memory aligned to `align` bytes, which has to be a power of two. If there's not enough memory within the arena, NULL is returned.
+static inline void *fix_arena_malloc_aligned(fix_arena *arena, unsigned int size, unsigned int align)
+{
+	FIX_ARENA_DEBUG_CHECK(arena);
+	uintptr_t address = (uintptr_t)&arena->memory[arena->offset];
+	unsigned int padding = (unsigned int)(-address & (uintptr_t)(align - 1));
+	if(padding > arena->size - arena->offset || size > arena->size - arena->offset - padding) {FIX_ARENA_STATS_FAIL(arena); return NULL;} //We can't allocate that much
+
+	void *mem = &arena->memory[arena->offset + padding];
+	arena->offset += padding + size;
+	FIX_ARENA_DEBUG_ALLOC(arena, mem, size);
+	FIX_ARENA_STATS_ALLOC(arena, size, padding);
+	return mem;
+}
+
+//Allocates a single T, aligned for its type
+#define fix_arena_push_struct(arena, T) ((T *)fix_arena_malloc_aligned((arena), sizeof(T), FIX_ARENA_ALIGNOF(T)))
+//Allocates an array of `count` T, aligned for its type
+#define fix_arena_push_array(arena, T, count) ((T *)fix_arena_malloc_aligned((arena), sizeof(T) * (count), FIX_ARENA_ALIGNOF(T)))
+//Allocates an array of `count` T, aligned to `align` bytes (e.g. 64 to start on a cache line)
+#define fix_arena_push_array_aligned(arena, T, count, align) ((T *)fix_arena_malloc_aligned((arena), sizeof(T) * (count), (align)))
+
+//Resizes `mem` from `old_size` to `new_size` bytes. If `mem` is the most recent allocation it's resized in place,
+//otherwise a new allocation aligned to `align` bytes is made and the old contents are copied over.
+//Returns NULL (leaving `mem` untouched) if there's not enough memory. Don't grow an allocation made before a saved marker.
+static inline void *fix_arena_realloc_aligned(fix_arena *arena, void *mem, unsigned int old_size, unsigned int new_size, unsigned int align)
+{
+	if(!mem) return fix_arena_malloc_aligned(arena, new_size, align);
+
+	unsigned int mem_offset = (unsigned int)((unsigned char *)mem - arena->memory);
+	if(mem_offset + old_size == arena->offset)
+	{
+		FIX_ARENA_DEBUG_CHECK(arena);
+		if(new_size > arena->size - mem_offset) {FIX_ARENA_STATS_FAIL(arena); return NULL;} //We can't allocate that much
+
+		if(new_size < old_size) FIX_ARENA_DEBUG_POISON(arena, mem_offset + new_size, arena->offset);
+		arena->offset = mem_offset + new_size;
+		FIX_ARENA_DEBUG_ALLOC(arena, mem, new_size);
+		if(new_size > old_size) FIX_ARENA_STATS_ALLOC(arena, new_size - old_size, 0);
+		return mem;
+	}
+
+	if(new_size <= old_size) return mem;
+
+	void *new_mem = fix_arena_malloc_aligned(arena, new_size, align);
+	if(new_mem) FIX_ARENA_MEMCPY(new_mem, mem, old_size);
+	return new_mem;
+}
+
+//Resizes `mem` from `old_size` to `new_size` bytes, in place if it's the most recent allocation
+static inline void *fix_arena_realloc(fix_arena *arena, void *mem, unsigned int old_size, unsigned int new_size)
+{
+	return fix_arena_realloc_aligned(arena, mem, old_size, new_size, 1);
+}
+
+//Growable array stored in an arena
+#define fix_arena_array(T) struct { unsigned int len; unsigned int cap; T *data; }
+#define fix_arena_array_init(arr) { (arr).len = 0; (arr).cap = 0; (arr).data = NULL; }
+//Makes room for at least `n` elements in total. Evaluates to 0 if the arena is out of memory.
+#define fix_arena_array_reserve(arena, arr, n) ((n) <= (arr).cap || fix_arena_array_grow((arena), (void **)&(arr).data, &(arr).cap, sizeof(*(arr).data), (n)))
+//Appends `item`. Evaluates to 0 if the arena is out of memory, the item is dropped then.
+#define fix_arena_array_push(arena, arr, item) (fix_arena_array_reserve((arena), (arr), (arr).len + 1) ? ((arr).data[(arr).len] = (item), (arr).len += 1, 1) : 0)
+#define fix_arena_array_pop(arr) ((arr).data[--(arr).len])
+#define fix_arena_array_clear(arr) { (arr).len = 0; }
+
+//Grows an array's storage to at least double its capacity and at least `min_cap` elements
+static inline int fix_arena_array_grow(fix_arena *arena, void **data, unsigned int *cap, unsigned int elem_size, unsigned int min_cap)
+{
+	unsigned int new_cap = *cap ? *cap * 2 : 8;
+	if(new_cap < min_cap) new_cap = min_cap;
+
+	//A type's alignment always divides its size, so the lowest set bit is a safe alignment for the elements
+	unsigned int align = elem_size & (0u - elem_size);
+	if(align > 64) align = 64;
+
+	void *new_data = fix_arena_realloc_aligned(arena, *data, *cap * elem_size, new_cap * elem_size, align);
+	if(!new_data) return 0;
+
+	*data = new_data;
+	*cap = new_cap;
+	return 1;
+}
+
+//Does nothing, but with FIX_ARENA_DEBUG it asserts that the arena handed `mem` out
 static inline void fix_arena_free(fix_arena *arena, void *mem)
 {
+#ifdef FIX_ARENA_DEBUG
+	FIX_ARENA_ASSERT((!mem || ((unsigned char *)mem >= arena->memory && (unsigned char *)mem <= arena->memory + arena->offset)) && "fix_arena: pointer doesn't belong to this arena");
+#endif //FIX_ARENA_DEBUG
 	(void)arena;
 	(void)mem;
 }
@@ -95,11 +494,497 @@ static inline void fix_arena_free(fix_arena *arena, void *mem)
 //Returns the memory offset to zero, treating the memory as empty. Use `zero` if you need to destroy the data.
 static inline void fix_arena_free_all(fix_arena *arena)
 {
+	FIX_ARENA_DEBUG_POISON(arena, 0, arena->offset);
+	arena->offset = 0;
+	FIX_ARENA_DEBUG_RESET(arena);
+}
+
+//Returns the current position of the arena, to be passed to `restore` once the allocations after it aren't needed
+static inline fix_arena_marker fix_arena_save(fix_arena *arena)
+{
+	fix_arena_marker marker;
+	marker.offset = arena->offset;
+#ifdef FIX_ARENA_DEBUG
+	arena->marker_depth += 1;
+	marker.depth = arena->marker_depth;
+#endif //FIX_ARENA_DEBUG
+	return marker;
+}
+
+//Frees everything allocated since the marker was saved. Markers have to be restored in the reverse order of saving.
+//Restoring an outer marker also discards every marker saved after it, the restored marker itself stays valid and can be
+//restored again (e.g. once per loop iteration).
+static inline void fix_arena_restore(fix_arena *arena, fix_arena_marker marker)
+{
+#ifdef FIX_ARENA_DEBUG
+	FIX_ARENA_ASSERT(marker.depth != 0 && marker.depth <= arena->marker_depth && "fix_arena: marker restored out of order");
+	FIX_ARENA_ASSERT(marker.offset <= arena->offset && "fix_arena: marker is past the current offset");
+	arena->marker_depth = marker.depth;
+#endif //FIX_ARENA_DEBUG
+	FIX_ARENA_DEBUG_POISON(arena, marker.offset, arena->offset);
+	arena->offset = marker.offset;
+}
+
+// Scratch arenas
+
+//A scratch arena borrowed by `fix_arena_scratch_begin`, along with where it has to be rolled back to
+struct fix_arena_scratch_s
+{
+	fix_arena *arena;
+	fix_arena_marker marker;
+};
+typedef struct fix_arena_scratch_s fix_arena_scratch;
+
+//Every thread's scratch arenas, defined once under FIX_ARENA_IMPL
+extern FIX_ARENA_THREAD_LOCAL fix_arena fix_arena_scratch_storage[FIX_ARENA_SCRATCH_COUNT];
+
+//Returns the calling thread's scratch arenas
+static inline fix_arena *fix_arena_scratch_arenas(void)
+{
+	return fix_arena_scratch_storage;
+}
+
+//Borrows one of the calling thread's scratch arenas that isn't any of the `conflicts`. No locking is involved.
+//Returns a scratch with a NULL arena if every scratch arena conflicts or the first-use malloc failed.
+static inline fix_arena_scratch fix_arena_scratch_begin(fix_arena **conflicts, unsigned int conflict_count)
+{
+	fix_arena_scratch scratch;
+	scratch.arena = NULL;
+
+	fix_arena *arenas = fix_arena_scratch_arenas();
+	for(unsigned int i = 0; i < FIX_ARENA_SCRATCH_COUNT; ++i)
+	{
+		fix_arena *arena = &arenas[i];
+
+		int conflicting = 0;
+		for(unsigned int j = 0; j < conflict_count; ++j)
+		{
+			if(conflicts[j] == arena) {conflicting = 1; break;}
+		}
+		if(conflicting) continue;
+
+		if(!arena->memory)
+		{
+			fix_arena_malloc_init(arena, FIX_ARENA_SCRATCH_SIZE);
+			if(!arena->memory) {arena->size = 0; break;}
+		}
+
+		scratch.arena = arena;
+		scratch.marker = fix_arena_save(arena);
+		break;
+	}
+
+	return scratch;
+}
+
+//Frees everything allocated in the scratch arena since `begin`
+static inline void fix_arena_scratch_end(fix_arena_scratch scratch)
+{
+	if(scratch.arena) fix_arena_restore(scratch.arena, scratch.marker);
+}
+
+//Frees the calling thread's scratch arenas. They will be malloc'ed again if the thread keeps using them.
+static inline void fix_arena_scratch_release(void)
+{
+	fix_arena *arenas = fix_arena_scratch_arenas();
+	for(unsigned int i = 0; i < FIX_ARENA_SCRATCH_COUNT; ++i)
+	{
+		if(!arenas[i].memory) continue;
+		fix_arena_free_destroy(&arenas[i]);
+		arenas[i].memory = NULL;
+	}
+}
+
+#if defined(FIX_ARENA_ATOMIC_LOAD) && defined(FIX_ARENA_ATOMIC_CAS)
+// Atomic arena
+
+struct fix_arena_atomic_s
+{
+	unsigned char *memory;
+	unsigned int size;
+	unsigned int offset; //Only ever touched atomically
+};
+typedef struct fix_arena_atomic_s fix_arena_atomic;
+
+//Sets the buffer as the atomic arena's memory. Not thread-safe.
+static inline void fix_arena_atomic_init(fix_arena_atomic *arena, unsigned int size, unsigned char *buffer)
+{
+	arena->memory = buffer;
+	arena->size = size;
+	arena->offset = 0;
+}
+
+//Allocates memory within the arena, safe to call from any thread. If there's not enough memory within the arena, NULL is returned.
+static inline void *fix_arena_atomic_malloc(fix_arena_atomic *arena, unsigned int size)
+{
+	unsigned int offset = FIX_ARENA_ATOMIC_LOAD(&arena->offset);
+	do
+	{
+		if(size > arena->size - offset) return NULL; //We can't allocate that much
+	} while(!FIX_ARENA_ATOMIC_CAS(&arena->offset, &offset, offset + size));
+
+	FIX_ARENA_ASAN_UNPOISON(&arena->memory[offset], size); //The memory may have been a local chunk before `free_all`
+	return &arena->memory[offset];
+}
+
+//Allocates memory aligned to `align` bytes, which has to be a power of two. Safe to call from any thread.
+static inline void *fix_arena_atomic_malloc_aligned(fix_arena_atomic *arena, unsigned int size, unsigned int align)
+{
+	unsigned int offset = FIX_ARENA_ATOMIC_LOAD(&arena->offset);
+	unsigned int padding;
+	do
+	{
+		//Recomputed for every offset we observe, so only the padding actually needed is reserved
+		padding = (unsigned int)(-(uintptr_t)&arena->memory[offset] & (uintptr_t)(align - 1));
+		if(padding > arena->size - offset || size > arena->size - offset - padding) return NULL; //We can't allocate that much
+	} while(!FIX_ARENA_ATOMIC_CAS(&arena->offset, &offset, offset + padding + size));
+
+	FIX_ARENA_ASAN_UNPOISON(&arena->memory[offset + padding], size);
+	return &arena->memory[offset + padding];
+}
+
+//Reserves a chunk of the shared arena and sets it as the memory of `local`, a thread-private arena.
+//Allocating from `local` needs no atomics at all. Returns 0 if the shared arena is full.
+static inline int fix_arena_atomic_reserve(fix_arena_atomic *arena, fix_arena *local, unsigned int chunk_size)
+{
+	unsigned char *chunk = (unsigned char *)fix_arena_atomic_malloc(arena, chunk_size);
+	if(!chunk) return 0;
+
+	fix_arena_init(local, chunk_size, chunk);
+	return 1;
+}
+
+//Allocates from the thread-private `local` arena, reserving a new chunk of at least `chunk_size` from the shared arena when it runs out.
+//Whatever was left in the previous chunk is wasted. `local` has to be initialized before the first call, `fix_arena_init(&local, 0, NULL)`
+//starts it out empty so the first call reserves a chunk. The memory isn't aligned, use `fix_arena_atomic_local_malloc_aligned` for that.
+static inline void *fix_arena_atomic_local_malloc(fix_arena_atomic *arena, fix_arena *local, unsigned int size, unsigned int chunk_size)
+{
+	void *mem = fix_arena_malloc(local, size);
+	if(mem) return mem;
+
+	if(!fix_arena_atomic_reserve(arena, local, size > chunk_size ? size : chunk_size)) return NULL;
+	return fix_arena_malloc(local, size);
+}
+
+//Same as `fix_arena_atomic_local_malloc`, but aligned to `align` bytes, which has to be a power of two
+static inline void *fix_arena_atomic_local_malloc_aligned(fix_arena_atomic *arena, fix_arena *local, unsigned int size, unsigned int align, unsigned int chunk_size)
+{
+	void *mem = fix_arena_malloc_aligned(local, size, align);
+	if(mem) return mem;
+
+	if(align - 1 > (unsigned int)-1 - size) return NULL; //The padded size doesn't fit in an unsigned int
+	unsigned int needed = size + align - 1; //Enough wherever the new chunk starts
+	if(!fix_arena_atomic_reserve(arena, local, needed > chunk_size ? needed : chunk_size)) return NULL;
+	return fix_arena_malloc_aligned(local, size, align);
+}
+
+//Does nothing
+static inline void fix_arena_atomic_free(fix_arena_atomic *arena, void *mem)
+{
+	(void)arena;
+	(void)mem;
+}
+
+//Returns the memory offset to zero. Not thread-safe, no other thread may be allocating (or still using a reserved chunk).
+static inline void fix_arena_atomic_free_all(fix_arena_atomic *arena)
+{
+	arena->offset = 0;
+}
+#endif //FIX_ARENA_ATOMIC_LOAD && FIX_ARENA_ATOMIC_CAS
+
+// Chained arena
+
+//Header placed in front of every block owned by a chained arena, the usable memory follows right after it
+struct fix_arena_block_s
+{
+	struct fix_arena_block_s *prev;
+	unsigned int size;
+};
+typedef struct fix_arena_block_s fix_arena_block;
+
+struct fix_arena_chain_s
+{
+	fix_arena arena; //Allocations are served from here, it always points into `block`
+	fix_arena_block *block; //Newest block, NULL until the first allocation
+	unsigned int block_size; //Minimum size of a newly linked block
+#ifdef FIX_ARENA_STATS
+	unsigned long long stats_size; //Size of all blocks together
+	unsigned long long stats_retired; //Bytes used in the blocks before the current one
+	unsigned long long stats_peak; //Most bytes ever in use across all blocks
+#endif //FIX_ARENA_STATS
+};
+typedef struct fix_arena_chain_s fix_arena_chain;
+
+#ifdef FIX_ARENA_STATS
+//Clears all gathered statistics of the chain, the sizes of the blocks it still owns are kept
+static inline void fix_arena_chain_stats_reset(fix_arena_chain *chain)
+{
+	fix_arena_stats_reset(&chain->arena);
+	chain->stats_peak = chain->stats_retired + chain->arena.offset;
+}
+
+static inline void fix_arena_chain_stats_alloc(fix_arena_chain *chain)
+{
+	unsigned long long used = chain->stats_retired + chain->arena.offset;
+	if(used > chain->stats_peak) chain->stats_peak = used;
+}
+
+//Prints the chain's statistics, over all of its blocks, and every tag to `out`
+static inline void fix_arena_chain_stats_dump(fix_arena_chain *chain, FILE *out)
+{
+	unsigned long long used = chain->stats_retired + chain->arena.offset;
+	//No percentage, the peak may have been reached in blocks `free_all` has freed since
+	fprintf(out, "fix_arena_chain %p: size %llu, in use %llu, peak %llu\n", (void *)chain, chain->stats_size, used, chain->stats_peak);
+	fix_arena_stats_dump_allocations(&chain->arena.stats, out);
+}
+
+#define FIX_ARENA_CHAIN_STATS_ALLOC(chain) fix_arena_chain_stats_alloc(chain)
+#define FIX_ARENA_CHAIN_STATS_SET(chain, size, retired) ((chain)->stats_size = (size), (chain)->stats_retired = (retired))
+#define FIX_ARENA_CHAIN_STATS_LINK(chain, size) ((chain)->stats_size += (size), (chain)->stats_retired += (chain)->arena.offset)
+#else
+#define FIX_ARENA_CHAIN_STATS_ALLOC(chain) ((void)0)
+#define FIX_ARENA_CHAIN_STATS_SET(chain, size, retired) ((void)0)
+#define FIX_ARENA_CHAIN_STATS_LINK(chain, size) ((void)0)
+#endif //FIX_ARENA_STATS
+
+//Sets up an empty chain. Nothing is malloc'ed until the first allocation
+static inline void fix_arena_chain_init(fix_arena_chain *chain, unsigned int block_size)
+{
+	fix_arena_init(&chain->arena, 0, NULL);
+	chain->block = NULL;
+	chain->block_size = block_size;
+	FIX_ARENA_CHAIN_STATS_SET(chain, 0, 0);
+#ifdef FIX_ARENA_STATS
+	chain->stats_peak = 0;
+#endif //FIX_ARENA_STATS
+}
+
+//Frees every block, and sets all chain info to zero
+static inline void fix_arena_chain_destroy(fix_arena_chain *chain)
+{
+	fix_arena_block *block = chain->block;
+	while(block)
+	{
+		fix_arena_block *prev = block->prev;
+		FIX_ARENA_FREE(block);
+		block = prev;
+	}
+
+	fix_arena_init(&chain->arena, 0, NULL);
+	chain->block = NULL;
+	chain->block_size = 0;
+	FIX_ARENA_CHAIN_STATS_SET(chain, 0, 0);
+}
+
+//Points the chain's arena at the block. Statistics (if any) carry over from the previous block.
+static inline void fix_arena_chain_use_block(fix_arena_chain *chain, fix_arena_block *block)
+{
+#ifdef FIX_ARENA_STATS
+	fix_arena_stats stats = chain->arena.stats;
+#endif //FIX_ARENA_STATS
+	fix_arena_init(&chain->arena, block->size, (unsigned char *)(block + 1));
+#ifdef FIX_ARENA_STATS
+	chain->arena.stats = stats;
+#endif //FIX_ARENA_STATS
+}
+
+//Links a new block that can fit at least `size` bytes. Each new block is at least twice as big as the previous one.
+static inline int fix_arena_chain_link(fix_arena_chain *chain, unsigned int size)
+{
+	unsigned int new_size = chain->block_size;
+	if(chain->block && chain->block->size > new_size / 2)
+	{
+		new_size = chain->block->size > (unsigned int)-1 / 2 ? (unsigned int)-1 : chain->block->size * 2;
+	}
+	if(size > new_size) new_size = size;
+
+	fix_arena_block *block = (fix_arena_block *)FIX_ARENA_MALLOC(sizeof(fix_arena_block) + new_size);
+	if(!block) return 0;
+
+	block->prev = chain->block;
+	block->size = new_size;
+	chain->block = block;
+	FIX_ARENA_CHAIN_STATS_LINK(chain, new_size);
+
+	fix_arena_chain_use_block(chain, block);
+	return 1;
+}
+
+//Allocates memory within the chain, linking a new block if the current one is full. NULL is only returned if malloc fails.
+static inline void *fix_arena_chain_malloc(fix_arena_chain *chain, unsigned int size)
+{
+	//Only a chain that can't link another block counts as a failed allocation
+	if(!fix_arena_fits(&chain->arena, size, 1) && !fix_arena_chain_link(chain, size)) {FIX_ARENA_STATS_FAIL(&chain->arena); return NULL;}
+
+	void *mem = fix_arena_malloc(&chain->arena, size);
+	FIX_ARENA_CHAIN_STATS_ALLOC(chain);
+	return mem;
+}
+
+//Allocates memory within the chain aligned to `align` bytes, which has to be a power of two
+static inline void *fix_arena_chain_malloc_aligned(fix_arena_chain *chain, unsigned int size, unsigned int align)
+{
+	if(!fix_arena_fits(&chain->arena, size, align))
+	{
+		//Reserve enough for the worst-case padding, the block start is only as aligned as malloc made it
+		if(align - 1 > (unsigned int)-1 - size || !fix_arena_chain_link(chain, size + align - 1)) {FIX_ARENA_STATS_FAIL(&chain->arena); return NULL;}
+	}
+
+	void *mem = fix_arena_malloc_aligned(&chain->arena, size, align);
+	FIX_ARENA_CHAIN_STATS_ALLOC(chain);
+	return mem;
+}
+
+//Does nothing
+static inline void fix_arena_chain_free(fix_arena_chain *chain, void *mem)
+{
+	(void)chain;
+	(void)mem;
+}
+
+//Frees every block except the largest one, and treats that one as empty
+static inline void fix_arena_chain_free_all(fix_arena_chain *chain)
+{
+	fix_arena_block *largest = chain->block;
+	if(!largest) return;
+
+	for(fix_arena_block *block = largest->prev; block; block = block->prev)
+	{
+		if(block->size > largest->size) largest = block;
+	}
+
+	fix_arena_block *block = chain->block;
+	while(block)
+	{
+		fix_arena_block *prev = block->prev;
+		if(block != largest) FIX_ARENA_FREE(block);
+		block = prev;
+	}
+
+	largest->prev = NULL;
+	chain->block = largest;
+	fix_arena_chain_use_block(chain, largest);
+	FIX_ARENA_CHAIN_STATS_SET(chain, largest->size, 0);
+}
+
+#ifdef FIX_ARENA_VM
+// Virtual memory arena
+
+struct fix_arena_vm_s
+{
+	unsigned char *memory;
+	size_t reserved; //Size of the address range, nothing past it can ever be allocated
+	size_t committed; //How much of the range is currently readable and writable
+	size_t offset;
+	size_t high_water; //How much committed memory `free_all` keeps
+};
+typedef struct fix_arena_vm_s fix_arena_vm;
+
+//Reserves `reserve` bytes of address space without committing any of it. Returns 0 if mmap fails.
+//`free_all` keeps up to `high_water` bytes committed so the next frame doesn't fault them in again.
+static inline int fix_arena_vm_init(fix_arena_vm *arena, size_t reserve, size_t high_water)
+{
+	reserve = (reserve + FIX_ARENA_VM_COMMIT_SIZE - 1) & ~(size_t)(FIX_ARENA_VM_COMMIT_SIZE - 1);
+	void *memory = mmap(NULL, reserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+	arena->memory = memory == MAP_FAILED ? NULL : (unsigned char *)memory;
+	arena->reserved = arena->memory ? reserve : 0;
+	arena->committed = 0;
+	arena->offset = 0;
+	arena->high_water = high_water;
+	return arena->memory != NULL;
+}
+
+//Unmaps the whole range, and sets all arena info to zero
+static inline void fix_arena_vm_destroy(fix_arena_vm *arena)
+{
+	if(arena->memory) munmap(arena->memory, arena->reserved);
+	arena->memory = NULL;
+	arena->reserved = 0;
+	arena->committed = 0;
 	arena->offset = 0;
 }
 
+//Commits pages until at least `end` bytes are usable. Returns 0 if the OS refuses.
+static inline int fix_arena_vm_commit(fix_arena_vm *arena, size_t end)
+{
+	size_t new_committed = (end + FIX_ARENA_VM_COMMIT_SIZE - 1) & ~(size_t)(FIX_ARENA_VM_COMMIT_SIZE - 1);
+	if(new_committed > arena->reserved) new_committed = arena->reserved;
+	if(new_committed <= arena->committed) return 1;
+
+	if(mprotect(arena->memory + arena->committed, new_committed - arena->committed, PROT_READ | PROT_WRITE) != 0) return 0;
+	arena->committed = new_committed;
+	return 1;
+}
+
+//Gives every committed page past `end` back to the OS
+static inline void fix_arena_vm_decommit(fix_arena_vm *arena, size_t end)
+{
+	size_t new_committed = (end + FIX_ARENA_VM_COMMIT_SIZE - 1) & ~(size_t)(FIX_ARENA_VM_COMMIT_SIZE - 1);
+	if(new_committed >= arena->committed) return;
+
+	madvise(arena->memory + new_committed, arena->committed - new_committed, MADV_DONTNEED);
+	mprotect(arena->memory + new_committed, arena->committed - new_committed, PROT_NONE);
+	arena->committed = new_committed;
+}
+
+//Allocates memory within the arena, committing more pages if needed. If the reserved range is exhausted, NULL is returned.
+static inline void *fix_arena_vm_malloc(fix_arena_vm *arena, size_t size)
+{
+	if(size > arena->reserved - arena->offset) return NULL; //We can't allocate that much
+	if(arena->offset + size > arena->committed && !fix_arena_vm_commit(arena, arena->offset + size)) return NULL;
+
+	void *mem = &arena->memory[arena->offset];
+	arena->offset += size;
+	return mem;
+}
+
+//Allocates memory aligned to `align` bytes, which has to be a power of two
+static inline void *fix_arena_vm_malloc_aligned(fix_arena_vm *arena, size_t size, size_t align)
+{
+	size_t padding = (size_t)(-(uintptr_t)&arena->memory[arena->offset] & (uintptr_t)(align - 1));
+	if(padding > arena->reserved - arena->offset) return NULL;
+
+	arena->offset += padding;
+	void *mem = fix_arena_vm_malloc(arena, size);
+	if(!mem) arena->offset -= padding;
+	return mem;
+}
+
+//Does nothing
+static inline void fix_arena_vm_free(fix_arena_vm *arena, void *mem)
+{
+	(void)arena;
+	(void)mem;
+}
+
+//Returns the memory offset to zero and decommits everything above the high-water mark
+static inline void fix_arena_vm_free_all(fix_arena_vm *arena)
+{
+	arena->offset = 0;
+	fix_arena_vm_decommit(arena, arena->high_water);
+}
+#endif //FIX_ARENA_VM
+
 #ifdef __cplusplus
 }
 #endif //_cplusplus
 
 #endif
+
+
+// Implementation Start
+#if defined(FIX_ARENA_IMPL) && !defined(FIX_ARENA_IMPL_DONE)
+#define FIX_ARENA_IMPL_DONE
+
+#ifdef __cplusplus
+extern "C"{
+#endif //_cplusplus
+
+FIX_ARENA_THREAD_LOCAL fix_arena fix_arena_scratch_storage[FIX_ARENA_SCRATCH_COUNT];
+
+#ifdef __cplusplus
+}
+#endif //_cplusplus
+
+#endif //FIX_ARENA_IMPL
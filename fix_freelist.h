@@ -8,7 +8,40 @@
 *
 * NOTES:
 * All functions are declared `static inline` for ease of use. If you do notice a performance hit, please do report it.
-* The freelist currently calls `malloc`, but only during `init`. This will likely be changed to take in a pre-existing buffer
+* `fix_freelist_init` calls `malloc`, `fix_freelist_buffer_init` takes a pre-existing buffer instead (huge pages, shared memory,
+* an mmap'd file...). The start of the buffer is aligned up to FIX_FREELIST_ALIGN, so any buffer works.
+* Define FIX_FREELIST_64BIT to use 64-bit sizes and offsets, for heaps bigger than 4 GiB.
+* Define FIX_FREELIST_ALIGN_LOG2 (default 3) to align every allocation to a bigger power of two, e.g. 4 for SSE.
+* Past 16 bytes, use `fix_freelist_buffer_init`, since `init` only gets whatever alignment malloc gives.
+*
+* The whole memory is split into blocks, each starting with a `fix_freelist_node` header. Free blocks are kept in
+* segregated size classes (TLSF-style): a first level per power of two, split into FIX_FREELIST_SL_COUNT linear
+* second-level bins, with a bitmap per level. Finding a fitting free block is a couple of bit scans, so `malloc`
+* and `free` take constant time no matter how many blocks are live.
+* Block sizes are rounded up to FIX_FREELIST_ALIGN bytes, and the returned memory is aligned to it.
+* Free blocks carry a boundary tag (a pointer to their header in their last bytes) and every header knows whether the
+* block right before it is free, so `free` merges a block with both of its free neighbours immediately.
+* There are never two free blocks next to each other, and large allocations keep working after heavy churn.
+* `fix_freelist_realloc` shrinks in place, grows in place into a free block right after it, and only copies as a last resort.
+*
+* A `fix_freelist` isn't thread-safe. For many threads, define FIX_FREELIST_CACHE, wrap the heap in a `fix_freelist_shared`
+* (a heap behind a spinlock) and give every thread its own `fix_freelist_cache`. Each cache keeps recently freed blocks in power-of-two size classes
+* up to FIX_FREELIST_CACHE_MAX_SIZE, refills from the shared heap and flushes back to it FIX_FREELIST_CACHE_BATCH blocks
+* at a time, so the lock is only taken once per batch. Blocks freed on a different thread than the one that allocated them
+* are pushed onto the owning cache's lock-free remote list, and picked up by the owner on its next refill.
+* Bigger allocations go straight to the shared heap. A cache may only be released once all of its blocks were freed.
+* The atomics use the GCC/Clang `__atomic` builtins, which is why the caches are opt-in: the rest of the freelist
+* compiles anywhere.
+*
+* Define FIX_FREELIST_DEBUG to check every `free` and `realloc`: pointers that don't belong to the freelist, aren't the start
+* of a block or were already freed trip FIX_FREELIST_ASSERT (default `assert`). Each allocation gets at least
+* FIX_FREELIST_DEBUG_GUARD_SIZE guard bytes after it, which are checked when it's freed, and freed memory is filled with 0xDD.
+* When compiled with AddressSanitizer, free memory and the guard bytes are poisoned instead, so ASan reports the bad access itself.
+* Blocks handed out by a `fix_freelist_cache` are only checked once the cache gives them back to the shared heap.
+*
+* Define FIX_FREELIST_STATS to track the bytes in use (and their peak), allocation/free counts, failed allocations
+* and bytes spent on headers and padding. `fix_freelist_tag_here` / `fix_freelist_set_tag` attribute the following allocations
+* to a call site, `fix_freelist_stats_dump` prints it all. Without FIX_FREELIST_STATS the tagging macros compile to nothing.
 */
 
 #ifndef FIX_LIST_ALLOC_H
@@ -18,135 +51,792 @@
 extern "C"{
 #endif //_cplusplus
 
-
-//TODO(Fix): Maybe take in a pre-prepared buffer?
 #include <stdlib.h> 
+#include <string.h>
+//Needed for uintptr_t, to align the start of caller buffers
+#include <stdint.h>
+
+#ifdef FIX_FREELIST_DEBUG
+#ifndef FIX_FREELIST_ASSERT
+#include <assert.h>
+#define FIX_FREELIST_ASSERT assert
+#endif //FIX_FREELIST_ASSERT
+#ifndef FIX_FREELIST_DEBUG_GUARD_SIZE
+#define FIX_FREELIST_DEBUG_GUARD_SIZE 8
+#endif //FIX_FREELIST_DEBUG_GUARD_SIZE
+#define FIX_FREELIST_DEBUG_MAGIC 0xF1EE1157u
+#define FIX_FREELIST_DEBUG_GUARD_BYTE 0xFD
+#define FIX_FREELIST_DEBUG_POISON_BYTE 0xDD
+
+#if defined(__SANITIZE_ADDRESS__)
+#define FIX_FREELIST_ASAN
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define FIX_FREELIST_ASAN
+#endif
+#endif
+#endif //FIX_FREELIST_DEBUG
+
+#ifdef FIX_FREELIST_ASAN
+#include <sanitizer/asan_interface.h>
+#define FIX_FREELIST_ASAN_POISON(addr, size) ASAN_POISON_MEMORY_REGION((addr), (size))
+#define FIX_FREELIST_ASAN_UNPOISON(addr, size) ASAN_UNPOISON_MEMORY_REGION((addr), (size))
+#else
+#define FIX_FREELIST_ASAN_POISON(addr, size) ((void)0)
+#define FIX_FREELIST_ASAN_UNPOISON(addr, size) ((void)0)
+#endif //FIX_FREELIST_ASAN
+
+#ifdef FIX_FREELIST_STATS
+#include <stdio.h>
+#ifndef FIX_FREELIST_STATS_TAG_MAX
+#define FIX_FREELIST_STATS_TAG_MAX 32
+#endif //FIX_FREELIST_STATS_TAG_MAX
+#endif //FIX_FREELIST_STATS
+
+#ifdef FIX_FREELIST_64BIT
+typedef unsigned long long fix_freelist_size;
+#define FIX_FREELIST_SIZE_BITS 64
+#else
+typedef unsigned int fix_freelist_size;
+#define FIX_FREELIST_SIZE_BITS 32
+#endif //FIX_FREELIST_64BIT
+
+//Alignment of every block, has to be at least 8 so a boundary tag fits into the smallest block
+#ifndef FIX_FREELIST_ALIGN_LOG2
+#define FIX_FREELIST_ALIGN_LOG2 3
+#endif //FIX_FREELIST_ALIGN_LOG2
+#define FIX_FREELIST_ALIGN (1u << FIX_FREELIST_ALIGN_LOG2)
+//Flags kept in `block_size`, sizes are multiples of FIX_FREELIST_ALIGN so the low bits are unused
+#define FIX_FREELIST_FREE_BIT ((fix_freelist_size)1) //The block is free
+#define FIX_FREELIST_PREV_FREE_BIT ((fix_freelist_size)2) //The block right before this one is free, and has a boundary tag
+#define FIX_FREELIST_SIZE_MASK (~(fix_freelist_size)(FIX_FREELIST_ALIGN - 1))
+
+#ifndef FIX_FREELIST_SL_LOG2
+#define FIX_FREELIST_SL_LOG2 4
+#endif //FIX_FREELIST_SL_LOG2
+#define FIX_FREELIST_SL_COUNT (1 << FIX_FREELIST_SL_LOG2)
+//Blocks below FIX_FREELIST_SMALL_BLOCK all live in the first first-level class, in FIX_FREELIST_ALIGN-sized steps
+#define FIX_FREELIST_FL_SHIFT (FIX_FREELIST_SL_LOG2 + FIX_FREELIST_ALIGN_LOG2)
+#define FIX_FREELIST_SMALL_BLOCK (1u << FIX_FREELIST_FL_SHIFT)
+#define FIX_FREELIST_FL_COUNT (FIX_FREELIST_SIZE_BITS - FIX_FREELIST_FL_SHIFT + 1)
 
 struct fix_freelist_node_s
 {
-	unsigned int block_offset;
-	unsigned int block_size;
-	struct fix_freelist_node_s *prev;
-	struct fix_freelist_node_s *next;
+	fix_freelist_size block_offset; //Offset of the block's memory from the start of the freelist's memory
+	fix_freelist_size block_size; //Size of the block's memory, the low bits hold the FIX_FREELIST_*_BIT flags
+	//Neighbours in the same size class while the block is free. Thread caches reuse them while a block is theirs.
+	union
+	{
+		struct fix_freelist_node_s *prev;
+		void *owner; //The `fix_freelist_cache` a used block belongs to, NULL if it came straight from the shared heap
+		struct fix_freelist_node_s *remote_next; //Link in a cache's remote list
+	};
+	union
+	{
+		struct fix_freelist_node_s *next; //Also the link in a cache's bin
+		unsigned int cache_class; //Class of a block handed out by a cache, or waiting in its remote list
+	};
+#ifdef FIX_FREELIST_DEBUG
+	fix_freelist_size debug_size; //Bytes asked for, the rest of a used block is guard bytes
+	unsigned int magic; //Last, so writing before the block's memory hits it first
+#endif //FIX_FREELIST_DEBUG
 };
 typedef struct fix_freelist_node_s fix_freelist_node;
 
+//Space taken by a header, padded so the block's memory stays aligned
+#define FIX_FREELIST_HEADER_SIZE ((sizeof(fix_freelist_node) + FIX_FREELIST_ALIGN - 1) & ~(size_t)(FIX_FREELIST_ALIGN - 1))
+
+
+#ifdef FIX_FREELIST_STATS
+struct fix_freelist_stats_tag_s
+{
+	const char *tag;
+	unsigned int count;
+	unsigned long long bytes;
+};
+typedef struct fix_freelist_stats_tag_s fix_freelist_stats_tag;
+
+struct fix_freelist_stats_s
+{
+	fix_freelist_size used; //Bytes currently allocated, headers included
+	fix_freelist_size peak_used;
+	unsigned int alloc_count;
+	unsigned int free_count;
+	unsigned int failed_count;
+	unsigned long long alloc_bytes;
+	unsigned long long overhead_bytes; //Bytes spent on headers and padding
+	const char *current_tag; //Tag given to the following allocations, NULL when untagged
+	unsigned int tag_count;
+	fix_freelist_stats_tag tags[FIX_FREELIST_STATS_TAG_MAX];
+};
+typedef struct fix_freelist_stats_s fix_freelist_stats;
+#endif //FIX_FREELIST_STATS
 
 struct fix_freelist_s
 {
 	unsigned char *memory;
-	unsigned int size;
-	fix_freelist_node *first_node;
-	fix_freelist_node *last_node;
+	fix_freelist_size size;
+	fix_freelist_size fl_bitmap; //Bit N is set if any bin of first-level class N has a free block
+	unsigned int sl_bitmap[FIX_FREELIST_FL_COUNT]; //Bit M is set if bin M of the class has a free block
+	fix_freelist_node *bins[FIX_FREELIST_FL_COUNT][FIX_FREELIST_SL_COUNT];
+#ifdef FIX_FREELIST_STATS
+	fix_freelist_stats stats;
+#endif //FIX_FREELIST_STATS
 };
 typedef struct fix_freelist_s fix_freelist;
 
+#define FIX_FREELIST_STRINGIFY_(x) #x
+#define FIX_FREELIST_STRINGIFY(x) FIX_FREELIST_STRINGIFY_(x)
+
+#ifdef FIX_FREELIST_STATS
+//Clears all gathered statistics of the freelist
+static inline void fix_freelist_stats_reset(fix_freelist *fl)
+{
+	memset(&fl->stats, 0, sizeof(fl->stats));
+}
+
+//Tags all following allocations from the freelist with `tag` (which has to outlive the freelist), NULL to stop tagging
+static inline void fix_freelist_set_tag(fix_freelist *fl, const char *tag)
+{
+	fl->stats.current_tag = tag;
+}
+
+static inline void fix_freelist_stats_alloc(fix_freelist *fl, fix_freelist_size size, fix_freelist_size overhead)
+{
+	fix_freelist_stats *stats = &fl->stats;
+	stats->alloc_count += 1;
+	stats->alloc_bytes += size;
+	stats->overhead_bytes += overhead;
+	stats->used += size + overhead;
+	if(stats->used > stats->peak_used) stats->peak_used = stats->used;
+	if(!stats->current_tag) return;
+
+	//Tags are compared by pointer, string literals from the same call site are the same pointer
+	unsigned int i = 0;
+	while(i < stats->tag_count && stats->tags[i].tag != stats->current_tag) ++i;
+	if(i == stats->tag_count)
+	{
+		if(stats->tag_count == FIX_FREELIST_STATS_TAG_MAX) return;
+		stats->tags[i].tag = stats->current_tag;
+		stats->tags[i].count = 0;
+		stats->tags[i].bytes = 0;
+		stats->tag_count += 1;
+	}
+	stats->tags[i].count += 1;
+	stats->tags[i].bytes += size;
+}
+
+static inline void fix_freelist_stats_resize(fix_freelist *fl, fix_freelist_size old_size, fix_freelist_size new_size)
+{
+	fix_freelist_stats *stats = &fl->stats;
+	stats->used = stats->used - old_size + new_size;
+	if(stats->used > stats->peak_used) stats->peak_used = stats->used;
+}
+
+//Prints the freelist's statistics and every tag to `out`
+static inline void fix_freelist_stats_dump(fix_freelist *fl, FILE *out)
+{
+	fix_freelist_stats *stats = &fl->stats;
+	fprintf(out, "fix_freelist %p: size %llu, used %llu, peak %llu (%.1f%%)\n", (void *)fl, (unsigned long long)fl->size,
+		(unsigned long long)stats->used, (unsigned long long)stats->peak_used, fl->size ? 100.0 * stats->peak_used / fl->size : 0.0);
+	fprintf(out, "  allocations %u (%llu bytes), frees %u, failed %u, overhead %llu bytes\n",
+		stats->alloc_count, stats->alloc_bytes, stats->free_count, stats->failed_count, stats->overhead_bytes);
+	for(unsigned int i = 0; i < stats->tag_count; ++i)
+	{
+		fprintf(out, "  %s: %u allocations, %llu bytes\n", stats->tags[i].tag, stats->tags[i].count, stats->tags[i].bytes);
+	}
+}
+
+#define FIX_FREELIST_STATS_ALLOC(fl, size, overhead) fix_freelist_stats_alloc(fl, size, overhead)
+#define FIX_FREELIST_STATS_FREE(fl, size, overhead) ((fl)->stats.free_count += 1, (fl)->stats.used -= (size) + (overhead))
+#define FIX_FREELIST_STATS_RESIZE(fl, old_size, new_size) fix_freelist_stats_resize(fl, old_size, new_size)
+#define FIX_FREELIST_STATS_FAIL(fl) ((fl)->stats.failed_count += 1)
+#define FIX_FREELIST_STATS_RESET(fl) fix_freelist_stats_reset(fl)
+#else
+#define fix_freelist_set_tag(fl, tag) ((void)0)
+#define FIX_FREELIST_STATS_ALLOC(fl, size, overhead) ((void)0)
+#define FIX_FREELIST_STATS_FREE(fl, size, overhead) ((void)0)
+#define FIX_FREELIST_STATS_RESIZE(fl, old_size, new_size) ((void)0)
+#define FIX_FREELIST_STATS_FAIL(fl) ((void)0)
+#define FIX_FREELIST_STATS_RESET(fl) ((void)0)
+#endif //FIX_FREELIST_STATS
+
+//Tags all following allocations from the freelist with the current file and line
+#define fix_freelist_tag_here(fl) fix_freelist_set_tag(fl, __FILE__ ":" FIX_FREELIST_STRINGIFY(__LINE__))
+
+#if defined(__GNUC__) || defined(__clang__)
+//Index of the lowest set bit, `word` can't be 0
+static inline unsigned int fix_freelist_ffs(fix_freelist_size word)
+{
+#ifdef FIX_FREELIST_64BIT
+	return (unsigned int)__builtin_ctzll(word);
+#else
+	return (unsigned int)__builtin_ctz(word);
+#endif //FIX_FREELIST_64BIT
+}
+
+//Index of the highest set bit, `word` can't be 0
+static inline unsigned int fix_freelist_fls(fix_freelist_size word)
+{
+#ifdef FIX_FREELIST_64BIT
+	return 63 - (unsigned int)__builtin_clzll(word);
+#else
+	return 31 - (unsigned int)__builtin_clz(word);
+#endif //FIX_FREELIST_64BIT
+}
+#else
+static inline unsigned int fix_freelist_ffs(fix_freelist_size word)
+{
+	unsigned int bit = 0;
+	while(!(word & 1)) {word >>= 1; bit += 1;}
+	return bit;
+}
+
+static inline unsigned int fix_freelist_fls(fix_freelist_size word)
+{
+	unsigned int bit = 0;
+	while(word >>= 1) bit += 1;
+	return bit;
+}
+#endif //__GNUC__
+
+static inline fix_freelist_size fix_freelist_block_size(fix_freelist_node *node)
+{
+	return node->block_size & FIX_FREELIST_SIZE_MASK;
+}
+
+static inline int fix_freelist_block_is_free(fix_freelist_node *node)
+{
+	return (node->block_size & FIX_FREELIST_FREE_BIT) != 0;
+}
+
+//Returns the block physically following `node`, NULL if `node` is the last one
+static inline fix_freelist_node *fix_freelist_next_block(fix_freelist *fl, fix_freelist_node *node)
+{
+	fix_freelist_size next_offset = node->block_offset + fix_freelist_block_size(node);
+	if(next_offset + FIX_FREELIST_HEADER_SIZE > fl->size) return NULL;
+	return (fix_freelist_node *)&fl->memory[next_offset];
+}
+
+//Returns the free block physically preceding `node`, read from its boundary tag. Only valid with FIX_FREELIST_PREV_FREE_BIT set.
+static inline fix_freelist_node *fix_freelist_prev_free_block(fix_freelist_node *node)
+{
+	return *((fix_freelist_node **)node - 1);
+}
+
+//Flags the block as free, writes its boundary tag and lets the next block know
+static inline void fix_freelist_mark_free(fix_freelist *fl, fix_freelist_node *node)
+{
+	node->block_size |= FIX_FREELIST_FREE_BIT;
+	unsigned char *end = (unsigned char *)node + FIX_FREELIST_HEADER_SIZE + fix_freelist_block_size(node);
+	*((fix_freelist_node **)end - 1) = node;
+	FIX_FREELIST_ASAN_POISON((unsigned char *)node + FIX_FREELIST_HEADER_SIZE, fix_freelist_block_size(node) - sizeof(fix_freelist_node *));
+
+	fix_freelist_node *next = fix_freelist_next_block(fl, node);
+	if(next) next->block_size |= FIX_FREELIST_PREV_FREE_BIT;
+}
+
+//Flags the block as used and lets the next block know
+static inline void fix_freelist_mark_used(fix_freelist *fl, fix_freelist_node *node)
+{
+	node->block_size &= ~FIX_FREELIST_FREE_BIT;
+
+	fix_freelist_node *next = fix_freelist_next_block(fl, node);
+	if(next) next->block_size &= ~FIX_FREELIST_PREV_FREE_BIT;
+}
+
+#ifdef FIX_FREELIST_DEBUG
+//Asserts that `mem` is a live allocation of the freelist whose guard bytes are intact
+static inline void fix_freelist_debug_check(fix_freelist *fl, void *mem)
+{
+	unsigned char *bytes = (unsigned char *)mem;
+	FIX_FREELIST_ASSERT(bytes >= fl->memory + FIX_FREELIST_HEADER_SIZE && bytes < fl->memory + fl->size && "fix_freelist: pointer doesn't belong to this freelist");
+
+	fix_freelist_node *node = (fix_freelist_node *)(bytes - FIX_FREELIST_HEADER_SIZE);
+	FIX_FREELIST_ASSERT(node->magic == FIX_FREELIST_DEBUG_MAGIC && node->block_offset == (fix_freelist_size)(bytes - fl->memory)
+		&& "fix_freelist: pointer isn't the start of a block, or was freed and merged already");
+	FIX_FREELIST_ASSERT(!fix_freelist_block_is_free(node) && "fix_freelist: double free");
+
+#ifndef FIX_FREELIST_ASAN
+	for(fix_freelist_size i = node->debug_size; i < fix_freelist_block_size(node); ++i)
+	{
+		FIX_FREELIST_ASSERT(bytes[i] == FIX_FREELIST_DEBUG_GUARD_BYTE && "fix_freelist: write past the end of a block");
+	}
+#endif //FIX_FREELIST_ASAN
+}
+
+//Remembers how many bytes of a used block were asked for, and guards the rest
+static inline void fix_freelist_debug_seal(fix_freelist_node *node, fix_freelist_size size)
+{
+	unsigned char *bytes = (unsigned char *)node + FIX_FREELIST_HEADER_SIZE;
+	node->debug_size = size;
+#ifdef FIX_FREELIST_ASAN
+	FIX_FREELIST_ASAN_POISON(bytes + size, fix_freelist_block_size(node) - size);
+#else
+	memset(bytes + size, FIX_FREELIST_DEBUG_GUARD_BYTE, fix_freelist_block_size(node) - size);
+#endif //FIX_FREELIST_ASAN
+}
+
+#define FIX_FREELIST_DEBUG_CHECK(fl, mem) fix_freelist_debug_check(fl, mem)
+#define FIX_FREELIST_DEBUG_SEAL(node, size) fix_freelist_debug_seal(node, size)
+#define FIX_FREELIST_DEBUG_MARK(node) ((node)->magic = FIX_FREELIST_DEBUG_MAGIC)
+#define FIX_FREELIST_DEBUG_POISON(mem, size) memset((mem), FIX_FREELIST_DEBUG_POISON_BYTE, (size))
+#else
+#define FIX_FREELIST_DEBUG_GUARD_SIZE 0
+#define FIX_FREELIST_DEBUG_CHECK(fl, mem) ((void)0)
+#define FIX_FREELIST_DEBUG_SEAL(node, size) ((void)0)
+#define FIX_FREELIST_DEBUG_MARK(node) ((void)0)
+#define FIX_FREELIST_DEBUG_POISON(mem, size) ((void)0)
+#endif //FIX_FREELIST_DEBUG
+
+//Finds the size class a free block of `size` bytes belongs to
+static inline void fix_freelist_mapping(fix_freelist_size size, unsigned int *fli, unsigned int *sli)
+{
+	if(size < FIX_FREELIST_SMALL_BLOCK)
+	{
+		*fli = 0;
+		*sli = size / (FIX_FREELIST_SMALL_BLOCK / FIX_FREELIST_SL_COUNT);
+		return;
+	}
+
+	unsigned int fl = fix_freelist_fls(size);
+	*sli = (size >> (fl - FIX_FREELIST_SL_LOG2)) ^ FIX_FREELIST_SL_COUNT;
+	*fli = fl - (FIX_FREELIST_FL_SHIFT - 1);
+}
+
+static inline void fix_freelist_bin_insert(fix_freelist *fl, fix_freelist_node *node)
+{
+	unsigned int fli, sli;
+	fix_freelist_mapping(fix_freelist_block_size(node), &fli, &sli);
+
+	node->prev = NULL;
+	node->next = fl->bins[fli][sli];
+	if(node->next) node->next->prev = node;
+	fl->bins[fli][sli] = node;
+
+	fl->fl_bitmap |= (fix_freelist_size)1 << fli;
+	fl->sl_bitmap[fli] |= 1u << sli;
+}
+
+static inline void fix_freelist_bin_remove(fix_freelist *fl, fix_freelist_node *node)
+{
+	unsigned int fli, sli;
+	fix_freelist_mapping(fix_freelist_block_size(node), &fli, &sli);
+
+	if(node->prev) node->prev->next = node->next;
+	if(node->next) node->next->prev = node->prev;
+	if(fl->bins[fli][sli] != node) return;
+
+	fl->bins[fli][sli] = node->next;
+	if(node->next) return;
+
+	fl->sl_bitmap[fli] &= ~(1u << sli);
+	if(!fl->sl_bitmap[fli]) fl->fl_bitmap &= ~((fix_freelist_size)1 << fli);
+}
+
+//Finds a free block of at least `size` bytes, NULL if there's none
+static inline fix_freelist_node *fix_freelist_find_free(fix_freelist *fl, fix_freelist_size size)
+{
+	unsigned int fli, sli;
+	fix_freelist_mapping(size, &fli, &sli);
+
+	//Round up to the next bin, so every block in the bin we land in is big enough
+	unsigned int search_fli = fli, search_sli = sli;
+	if(size >= FIX_FREELIST_SMALL_BLOCK)
+	{
+		fix_freelist_size round = ((fix_freelist_size)1 << (fix_freelist_fls(size) - FIX_FREELIST_SL_LOG2)) - 1;
+		if(size <= ~(fix_freelist_size)0 - round) fix_freelist_mapping(size + round, &search_fli, &search_sli);
+		else search_fli = FIX_FREELIST_FL_COUNT;
+	}
+
+	if(search_fli < FIX_FREELIST_FL_COUNT)
+	{
+		unsigned int sl_map = fl->sl_bitmap[search_fli] & (~0u << search_sli);
+		if(!sl_map)
+		{
+			fix_freelist_size fl_map = search_fli + 1 < FIX_FREELIST_SIZE_BITS ? fl->fl_bitmap & (~(fix_freelist_size)0 << (search_fli + 1)) : 0;
+			if(fl_map)
+			{
+				search_fli = fix_freelist_ffs(fl_map);
+				sl_map = fl->sl_bitmap[search_fli];
+			}
+		}
+		if(sl_map) return fl->bins[search_fli][fix_freelist_ffs(sl_map)];
+	}
+
+	//Nothing is guaranteed to fit, but the first block of the exact bin still might
+	fix_freelist_node *node = fl->bins[fli][sli];
+	if(node && fix_freelist_block_size(node) >= size) return node;
+	return NULL;
+}
+
+//Treats the whole memory as one free block again
+static inline void fix_freelist_free_all(fix_freelist *fl)
+{
+	fl->fl_bitmap = 0;
+	for(unsigned int fli = 0; fli < FIX_FREELIST_FL_COUNT; ++fli)
+	{
+		fl->sl_bitmap[fli] = 0;
+		for(unsigned int sli = 0; sli < FIX_FREELIST_SL_COUNT; ++sli) fl->bins[fli][sli] = NULL;
+	}
+#ifdef FIX_FREELIST_STATS
+	fl->stats.used = 0;
+#endif //FIX_FREELIST_STATS
+
+	if(fl->size < FIX_FREELIST_HEADER_SIZE + FIX_FREELIST_ALIGN) return;
+	FIX_FREELIST_ASAN_UNPOISON(fl->memory, fl->size);
+
+	fix_freelist_node *node = (fix_freelist_node *)&fl->memory[0];
+	FIX_FREELIST_DEBUG_MARK(node);
+	node->block_offset = FIX_FREELIST_HEADER_SIZE;
+	node->block_size = (fl->size - FIX_FREELIST_HEADER_SIZE) & FIX_FREELIST_SIZE_MASK;
+	fix_freelist_mark_free(fl, node);
+	fix_freelist_bin_insert(fl, node);
+}
+
 //Mallocs a block of memory and sets it as the freelist's memory
-static inline void fix_freelist_init(fix_freelist *fl, unsigned int size)
+static inline void fix_freelist_init(fix_freelist *fl, fix_freelist_size size)
 {
 	fl->memory = (unsigned char *)malloc(size * sizeof(char));
-	fl->size = size;
+	fl->size = fl->memory ? size : 0;
+	FIX_FREELIST_STATS_RESET(fl);
 
-	fl->first_node = NULL;
-	fl->last_node = NULL;
+	fix_freelist_free_all(fl);
 }
 
 //Frees the malloc'ed memory, and sets all freelist info to zero
 static inline void fix_freelist_destroy(fix_freelist *fl)
 {
+	FIX_FREELIST_ASAN_UNPOISON(fl->memory, fl->size);
 	free(fl->memory);
 	fl->size = 0;
 }
 
-//allocates memory within the freelist. If there's not enough memory within the fl, NULL is returned.
-static inline void *fix_freelist_malloc(fix_freelist *fl, unsigned int size)
+//Sets the buffer as the freelist's memory. Its start is aligned up to FIX_FREELIST_ALIGN, losing a few bytes if needed.
+static inline void fix_freelist_buffer_init(fix_freelist *fl, fix_freelist_size size, unsigned char *buffer)
+{
+	fix_freelist_size padding = (fix_freelist_size)(-(uintptr_t)buffer & (FIX_FREELIST_ALIGN - 1));
+	fl->memory = buffer + padding;
+	fl->size = size > padding ? size - padding : 0;
+	FIX_FREELIST_STATS_RESET(fl);
+
+	fix_freelist_free_all(fl);
+}
+
+//Sets all freelist info to zero, doesn't destroy the buffer
+static inline void fix_freelist_buffer_destroy(fix_freelist *fl)
+{
+	FIX_FREELIST_ASAN_UNPOISON(fl->memory, fl->size);
+	fl->memory = NULL;
+	fl->size = 0;
+}
+
+//Cuts everything past `block_size` off a used block and frees it, as long as it's big enough to be a block of its own
+static inline void fix_freelist_trim(fix_freelist *fl, fix_freelist_node *node, fix_freelist_size block_size)
 {
-	//Nothing allocated yet
-	if(!fl->last_node)
+	fix_freelist_size size = fix_freelist_block_size(node);
+	if(size < block_size + FIX_FREELIST_HEADER_SIZE + FIX_FREELIST_ALIGN) return;
+
+	node->block_size = block_size | (node->block_size & ~FIX_FREELIST_SIZE_MASK);
+
+	fix_freelist_size rest_offset = node->block_offset + block_size;
+	fix_freelist_node *rest = (fix_freelist_node *)&fl->memory[rest_offset];
+	FIX_FREELIST_DEBUG_MARK(rest);
+	rest->block_offset = rest_offset + FIX_FREELIST_HEADER_SIZE;
+	rest->block_size = size - block_size - FIX_FREELIST_HEADER_SIZE;
+
+	//When shrinking, the cut-off part can be followed by a free block
+	fix_freelist_node *next = fix_freelist_next_block(fl, rest);
+	if(next && fix_freelist_block_is_free(next))
 	{
-		fix_freelist_node *new_node = (fix_freelist_node*)&fl->memory[0];
-		new_node->prev = NULL;
-		new_node->next = NULL;
-		new_node->block_size = size;
-		new_node->block_offset = sizeof(*new_node);
-		fl->last_node = new_node;
-		fl->first_node = new_node;
-		return &fl->memory[new_node->block_offset];
+		fix_freelist_bin_remove(fl, next);
+		rest->block_size += FIX_FREELIST_HEADER_SIZE + fix_freelist_block_size(next);
+		FIX_FREELIST_DEBUG_POISON(next, FIX_FREELIST_HEADER_SIZE);
 	}
 
-	//We can fit it at the end
-	if(fl->last_node->block_offset + fl->last_node->block_size + sizeof(fix_freelist_node) < fl->size)
+	fix_freelist_mark_free(fl, rest);
+	fix_freelist_bin_insert(fl, rest);
+}
+
+//allocates memory within the freelist. If there's not enough memory within the fl, NULL is returned.
+static inline void *fix_freelist_malloc(fix_freelist *fl, fix_freelist_size size)
+{
+	fix_freelist_size block_size = (size + FIX_FREELIST_DEBUG_GUARD_SIZE + FIX_FREELIST_ALIGN - 1) & FIX_FREELIST_SIZE_MASK;
+	if(block_size < size) {FIX_FREELIST_STATS_FAIL(fl); return NULL;} //Overflowed
+	if(block_size == 0) block_size = FIX_FREELIST_ALIGN;
+
+	fix_freelist_node *node = fix_freelist_find_free(fl, block_size);
+	if(!node) {FIX_FREELIST_STATS_FAIL(fl); return NULL;}
+	fix_freelist_bin_remove(fl, node);
+	FIX_FREELIST_ASAN_UNPOISON(&fl->memory[node->block_offset], fix_freelist_block_size(node));
+
+	fix_freelist_mark_used(fl, node);
+	fix_freelist_trim(fl, node, block_size);
+	FIX_FREELIST_DEBUG_SEAL(node, size);
+	FIX_FREELIST_STATS_ALLOC(fl, size, fix_freelist_block_size(node) - size + FIX_FREELIST_HEADER_SIZE);
+	return &fl->memory[node->block_offset];
+}
+
+//Frees the memory, merging its block with any free neighbours and putting the result back into its size class. Doesn't zero it.
+static inline void fix_freelist_free(fix_freelist *fl, void *mem)
+{
+	FIX_FREELIST_DEBUG_CHECK(fl, mem);
+	fix_freelist_node *node = (fix_freelist_node*)(((unsigned char*)mem) - FIX_FREELIST_HEADER_SIZE);
+	FIX_FREELIST_STATS_FREE(fl, fix_freelist_block_size(node), FIX_FREELIST_HEADER_SIZE);
+	FIX_FREELIST_ASAN_UNPOISON(mem, fix_freelist_block_size(node));
+	FIX_FREELIST_DEBUG_POISON(mem, fix_freelist_block_size(node));
+
+	fix_freelist_node *next = fix_freelist_next_block(fl, node);
+	if(next && fix_freelist_block_is_free(next))
 	{
-		unsigned int node_offset = fl->last_node->block_offset + fl->last_node->block_size;
-		fix_freelist_node *new_node = (fix_freelist_node*)&fl->memory[node_offset];
-		fl->last_node->next = new_node;
-		new_node->prev = fl->last_node;
-		new_node->next = NULL;
-		new_node->block_offset = node_offset + sizeof(*new_node);
-		new_node->block_size = size;
+		fix_freelist_bin_remove(fl, next);
+		node->block_size += FIX_FREELIST_HEADER_SIZE + fix_freelist_block_size(next);
+		FIX_FREELIST_DEBUG_POISON(next, FIX_FREELIST_HEADER_SIZE);
+	}
 
-		fl->last_node = new_node;
-		return &fl->memory[new_node->block_offset];
+	if(node->block_size & FIX_FREELIST_PREV_FREE_BIT)
+	{
+		fix_freelist_node *prev = fix_freelist_prev_free_block(node);
+		fix_freelist_bin_remove(fl, prev);
+		prev->block_size += FIX_FREELIST_HEADER_SIZE + fix_freelist_block_size(node);
+		FIX_FREELIST_DEBUG_POISON(node, FIX_FREELIST_HEADER_SIZE);
+		node = prev;
 	}
 
-	//Maybe at the start?
-	if(fl->first_node != (fix_freelist_node*)&fl->memory[0])
+	fix_freelist_mark_free(fl, node);
+	fix_freelist_bin_insert(fl, node);
+}
+
+//Resizes the memory to `size` bytes. Shrinking, or growing into a free block right after it, happens in place.
+//Otherwise the contents are copied into a new allocation and the old one is freed.
+//If there's not enough memory within the fl, NULL is returned and the old memory is left untouched.
+static inline void *fix_freelist_realloc(fix_freelist *fl, void *mem, fix_freelist_size size)
+{
+	if(!mem) return fix_freelist_malloc(fl, size);
+	FIX_FREELIST_DEBUG_CHECK(fl, mem);
+
+	fix_freelist_size block_size = (size + FIX_FREELIST_DEBUG_GUARD_SIZE + FIX_FREELIST_ALIGN - 1) & FIX_FREELIST_SIZE_MASK;
+	if(block_size < size) {FIX_FREELIST_STATS_FAIL(fl); return NULL;} //Overflowed
+	if(block_size == 0) block_size = FIX_FREELIST_ALIGN;
+
+	fix_freelist_node *node = (fix_freelist_node*)(((unsigned char*)mem) - FIX_FREELIST_HEADER_SIZE);
+	fix_freelist_size old_size = fix_freelist_block_size(node);
+#ifdef FIX_FREELIST_DEBUG
+	fix_freelist_size copy_size = node->debug_size; //The guard bytes don't need copying, and ASan might have them poisoned
+#else
+	fix_freelist_size copy_size = old_size;
+#endif //FIX_FREELIST_DEBUG
+
+	if(block_size > old_size)
 	{
-		unsigned int free_space = fl->first_node->block_offset - sizeof(fix_freelist_node);
-		if(free_space >= size + sizeof(fix_freelist_node)) 
+		fix_freelist_node *next = fix_freelist_next_block(fl, node);
+		if(!next || !fix_freelist_block_is_free(next) || old_size + FIX_FREELIST_HEADER_SIZE + fix_freelist_block_size(next) < block_size)
 		{
-			fix_freelist_node *node = (fix_freelist_node*)&fl->memory[0];
-			node->prev = NULL;
-			node->next = fl->first_node;
-			node->next->prev = node;
-			node->block_size = size;
-			node->block_offset = sizeof(*node);
-			fl->first_node = node;
-			return &fl->memory[node->block_offset];
+			void *new_mem = fix_freelist_malloc(fl, size);
+			if(!new_mem) return NULL;
+
+			memcpy(new_mem, mem, copy_size);
+			fix_freelist_free(fl, mem);
+			return new_mem;
 		}
+
+		fix_freelist_bin_remove(fl, next);
+		node->block_size += FIX_FREELIST_HEADER_SIZE + fix_freelist_block_size(next);
+		fix_freelist_mark_used(fl, node);
+		FIX_FREELIST_DEBUG_POISON(next, FIX_FREELIST_HEADER_SIZE);
 	}
 
-	//Can we fit it anywhere in the middle?
-	fix_freelist_node *node = fl->first_node;
-	while(node->next)
+	FIX_FREELIST_ASAN_UNPOISON(mem, fix_freelist_block_size(node));
+	fix_freelist_trim(fl, node, block_size);
+	FIX_FREELIST_DEBUG_SEAL(node, size);
+	FIX_FREELIST_STATS_RESIZE(fl, old_size, fix_freelist_block_size(node));
+	return mem;
+}
+
+#ifdef FIX_FREELIST_CACHE
+// Thread caches
+
+#ifndef FIX_FREELIST_CACHE_MIN_LOG2
+#define FIX_FREELIST_CACHE_MIN_LOG2 4 //Smallest class holds 16 bytes
+#endif //FIX_FREELIST_CACHE_MIN_LOG2
+#ifndef FIX_FREELIST_CACHE_CLASS_COUNT
+#define FIX_FREELIST_CACHE_CLASS_COUNT 8 //Biggest class holds 2048 bytes
+#endif //FIX_FREELIST_CACHE_CLASS_COUNT
+#define FIX_FREELIST_CACHE_MAX_SIZE ((fix_freelist_size)1 << (FIX_FREELIST_CACHE_MIN_LOG2 + FIX_FREELIST_CACHE_CLASS_COUNT - 1))
+#ifndef FIX_FREELIST_CACHE_BATCH
+#define FIX_FREELIST_CACHE_BATCH 32 //How many blocks move between a cache and the shared heap at once
+#endif //FIX_FREELIST_CACHE_BATCH
+
+struct fix_freelist_shared_s
+{
+	fix_freelist heap;
+	int lock;
+};
+typedef struct fix_freelist_shared_s fix_freelist_shared;
+
+struct fix_freelist_cache_s
+{
+	fix_freelist_shared *shared;
+	fix_freelist_node *bins[FIX_FREELIST_CACHE_CLASS_COUNT]; //Cached blocks, linked through `next`
+	unsigned int counts[FIX_FREELIST_CACHE_CLASS_COUNT];
+	fix_freelist_node *remote; //Blocks freed by other threads, only ever touched atomically
+};
+typedef struct fix_freelist_cache_s fix_freelist_cache;
+
+//Sets up the lock. Call it after setting up `shared->heap` with any of the init functions, before any thread uses it.
+static inline void fix_freelist_shared_init(fix_freelist_shared *shared)
+{
+	shared->lock = 0;
+}
+
+static inline void fix_freelist_shared_lock(fix_freelist_shared *shared)
+{
+	while(__atomic_exchange_n(&shared->lock, 1, __ATOMIC_ACQUIRE))
 	{
-		unsigned int free_space = (node->next->block_offset) - (node->block_offset + node->block_size);
-		if(free_space < size + sizeof(fix_freelist_node)) {node = node->next; continue;}
+		while(__atomic_load_n(&shared->lock, __ATOMIC_RELAXED));
+	}
+}
+
+static inline void fix_freelist_shared_unlock(fix_freelist_shared *shared)
+{
+	__atomic_store_n(&shared->lock, 0, __ATOMIC_RELEASE);
+}
 
-		unsigned int node_offset = node->block_offset + node->block_size;
-		fix_freelist_node *new_node = (fix_freelist_node*)&fl->memory[node_offset];
+static inline void fix_freelist_cache_init(fix_freelist_cache *cache, fix_freelist_shared *shared)
+{
+	cache->shared = shared;
+	for(unsigned int i = 0; i < FIX_FREELIST_CACHE_CLASS_COUNT; ++i)
+	{
+		cache->bins[i] = NULL;
+		cache->counts[i] = 0;
+	}
+	cache->remote = NULL;
+}
 
-		new_node->prev = node;
-		new_node->next = node->next;
+//Smallest class able to hold `size` bytes
+static inline unsigned int fix_freelist_cache_class(fix_freelist_size size)
+{
+	if(size <= ((fix_freelist_size)1 << FIX_FREELIST_CACHE_MIN_LOG2)) return 0;
+	return fix_freelist_fls(size - 1) + 1 - FIX_FREELIST_CACHE_MIN_LOG2;
+}
 
-		node->next = new_node;
-		new_node->next->prev = new_node;
+//The block's size isn't read here, the shared heap may be updating its flags at the same time
+static inline void fix_freelist_cache_push(fix_freelist_cache *cache, fix_freelist_node *node, unsigned int cls)
+{
+	node->next = cache->bins[cls];
+	cache->bins[cls] = node;
+	cache->counts[cls] += 1;
+}
 
-		new_node->block_offset = node_offset + sizeof(*new_node);
-		new_node->block_size = size;
+//Moves every block other threads have freed into the bins
+static inline void fix_freelist_cache_drain_remote(fix_freelist_cache *cache)
+{
+	if(!__atomic_load_n(&cache->remote, __ATOMIC_RELAXED)) return;
 
-		return &fl->memory[new_node->block_offset];
+	fix_freelist_node *node = __atomic_exchange_n(&cache->remote, (fix_freelist_node *)NULL, __ATOMIC_ACQUIRE);
+	while(node)
+	{
+		fix_freelist_node *next = node->remote_next;
+		fix_freelist_cache_push(cache, node, node->cache_class);
+		node = next;
 	}
+}
 
-	return NULL;
+//Takes a batch of blocks of the class from the shared heap
+static inline void fix_freelist_cache_refill(fix_freelist_cache *cache, unsigned int cls)
+{
+	fix_freelist_size size = (fix_freelist_size)1 << (cls + FIX_FREELIST_CACHE_MIN_LOG2);
+
+	fix_freelist_shared_lock(cache->shared);
+	for(unsigned int i = 0; i < FIX_FREELIST_CACHE_BATCH; ++i)
+	{
+		unsigned char *mem = (unsigned char *)fix_freelist_malloc(&cache->shared->heap, size);
+		if(!mem) break;
+
+		fix_freelist_cache_push(cache, (fix_freelist_node *)(mem - FIX_FREELIST_HEADER_SIZE), cls);
+	}
+	fix_freelist_shared_unlock(cache->shared);
 }
 
-//Frees the memory by removing it from the linked list. Doesn't zero it.
-static inline void fix_freelist_free(fix_freelist *fl, void *mem)
+//Gives up to `count` blocks of the class back to the shared heap
+static inline void fix_freelist_cache_flush(fix_freelist_cache *cache, unsigned int cls, unsigned int count)
 {
-	fix_freelist_node *node = (fix_freelist_node*)(((unsigned char*)mem) - sizeof(fix_freelist_node));
-	if(node->prev) node->prev->next = node->next;
-	if(node->next) node->next->prev = node->prev;
+	fix_freelist_shared_lock(cache->shared);
+	while(count && cache->bins[cls])
+	{
+		fix_freelist_node *node = cache->bins[cls];
+		cache->bins[cls] = node->next;
+		cache->counts[cls] -= 1;
+		count -= 1;
 
-	if(node == fl->last_node) fl->last_node = node->prev;
-	if(node == fl->first_node) fl->first_node = node->next;
+		fix_freelist_free(&cache->shared->heap, (unsigned char *)node + FIX_FREELIST_HEADER_SIZE);
+	}
+	fix_freelist_shared_unlock(cache->shared);
 }
 
-static inline void fix_freelist_free_all(fix_freelist *fl)
+//Allocates memory through the calling thread's cache. If the shared heap is out of memory, NULL is returned.
+static inline void *fix_freelist_cache_malloc(fix_freelist_cache *cache, fix_freelist_size size)
 {
-	fl->first_node = NULL;
-	fl->last_node = NULL;
+	if(size > FIX_FREELIST_CACHE_MAX_SIZE)
+	{
+		fix_freelist_shared_lock(cache->shared);
+		unsigned char *mem = (unsigned char *)fix_freelist_malloc(&cache->shared->heap, size);
+		fix_freelist_shared_unlock(cache->shared);
+
+		if(mem) ((fix_freelist_node *)(mem - FIX_FREELIST_HEADER_SIZE))->owner = NULL;
+		return mem;
+	}
+
+	unsigned int cls = fix_freelist_cache_class(size);
+	if(!cache->bins[cls]) fix_freelist_cache_drain_remote(cache);
+	if(!cache->bins[cls]) fix_freelist_cache_refill(cache, cls);
+
+	fix_freelist_node *node = cache->bins[cls];
+	if(!node) return NULL;
+
+	cache->bins[cls] = node->next;
+	cache->counts[cls] -= 1;
+	node->owner = cache;
+	node->cache_class = cls;
+	return (unsigned char *)node + FIX_FREELIST_HEADER_SIZE;
+}
+
+//Frees memory allocated through any thread's cache. `cache` has to be the calling thread's own cache.
+static inline void fix_freelist_cache_free(fix_freelist_cache *cache, void *mem)
+{
+	fix_freelist_node *node = (fix_freelist_node *)((unsigned char *)mem - FIX_FREELIST_HEADER_SIZE);
+	fix_freelist_cache *owner = (fix_freelist_cache *)node->owner;
+
+	if(!owner)
+	{
+		fix_freelist_shared_lock(cache->shared);
+		fix_freelist_free(&cache->shared->heap, mem);
+		fix_freelist_shared_unlock(cache->shared);
+		return;
+	}
+
+	unsigned int cls = node->cache_class;
+	if(owner != cache)
+	{
+		node->remote_next = __atomic_load_n(&owner->remote, __ATOMIC_RELAXED);
+		while(!__atomic_compare_exchange_n(&owner->remote, &node->remote_next, node, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+		return;
+	}
+
+	fix_freelist_cache_push(cache, node, cls);
+	if(cache->counts[cls] > 2 * FIX_FREELIST_CACHE_BATCH) fix_freelist_cache_flush(cache, cls, FIX_FREELIST_CACHE_BATCH);
+}
+
+//Gives every cached block back to the shared heap. Call it before the thread exits.
+static inline void fix_freelist_cache_release(fix_freelist_cache *cache)
+{
+	fix_freelist_cache_drain_remote(cache);
+	for(unsigned int cls = 0; cls < FIX_FREELIST_CACHE_CLASS_COUNT; ++cls)
+	{
+		fix_freelist_cache_flush(cache, cls, cache->counts[cls]);
+	}
 }
+#endif //FIX_FREELIST_CACHE
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,333 @@
+/* fix_jobs.h
+* License: Public Domain or zlib
+*
+* To use this library, remember to define FIX_JOBS_IMPL in ONE C or C++ file.
+* fix_jobs is built on fix_wsdeque.h and fix_mpmc.h, so their implementations have to be compiled in ONE file too,
+* this one or any other. Implementation sections only ever compile once per file, so a file that already included
+* either header with its IMPL defined is fine:
+* #define FIX_WSDEQUE_IMPL
+* #define FIX_MPMC_IMPL
+* #define FIX_JOBS_IMPL
+* #include "fix_jobs.h"
+*
+* Build with -pthread. It needs GCC or Clang, since the deques and queues use the `__atomic` builtins, but not libatomic:
+* none of its atomics is wider than a pointer or a `long long`. It doesn't use fix_lfstack.h, so no -latomic either.
+*
+* Work-stealing thread pool (pthreads)
+*
+* Every worker owns a `fix_wsdeque`. Jobs submitted from inside a job go onto the current worker's deque, everything else
+* goes through a shared `fix_mpmc` injection queue. An idle worker takes from its own deque first, then the injection queue,
+* then steals the oldest job of another worker, so big jobs that split themselves up spread over all the cores.
+* Workers that find nothing for a while sleep on a condition variable until new jobs arrive.
+*
+* Jobs are yours: fix_jobs doesn't allocate or copy them, so a `fix_job` has to stay alive until it has run.
+* If the injection queue is full, `submit` runs the job right away on the calling thread instead.
+* `fix_jobs_wait` waits for every job of the pool, so it can't be called from inside a job. A job that splits itself up
+* points its sub-jobs' `counter` at a shared int and calls `fix_jobs_wait_counter` instead.
+* Both run jobs on the calling thread while they wait, instead of blocking it.
+*
+* Define FIX_JOBS_WORKERS_MAX (default 64) and FIX_JOBS_INJECT_SIZE (default 1024, a power of two) to change the limits.
+*
+* Example Usage:
+* void shade_tile(void *arg) {...}
+* fix_jobs pool;
+* fix_jobs_init(&pool, 0); //One worker per core
+* fix_job tiles[64];
+* for(int i = 0; i < 64; ++i) {tiles[i].fn = shade_tile; tiles[i].arg = &tile_data[i]; tiles[i].counter = NULL; fix_jobs_submit(&pool, &tiles[i]);}
+* fix_jobs_wait(&pool);
+* fix_jobs_destroy(&pool);
+*/
+
+#ifndef FIX_JOBS_H
+#define FIX_JOBS_H
+
+#include <pthread.h>
+#include "fix_wsdeque.h"
+#include "fix_mpmc.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif //_cplusplus
+
+#ifndef FIX_JOBS_WORKERS_MAX
+#define FIX_JOBS_WORKERS_MAX 64
+#endif //FIX_JOBS_WORKERS_MAX
+
+#ifndef FIX_JOBS_INJECT_SIZE
+#define FIX_JOBS_INJECT_SIZE 1024
+#endif //FIX_JOBS_INJECT_SIZE
+
+#if FIX_JOBS_INJECT_SIZE < 2 || (FIX_JOBS_INJECT_SIZE & (FIX_JOBS_INJECT_SIZE - 1))
+#error "fix_jobs: FIX_JOBS_INJECT_SIZE has to be a power of two, and at least 2"
+#endif
+
+#ifndef FIX_JOBS_DEQUE_SIZE
+#define FIX_JOBS_DEQUE_SIZE 256 //Starting capacity of a worker's deque, it grows as needed
+#endif //FIX_JOBS_DEQUE_SIZE
+
+typedef void (*fix_job_fn)(void *arg);
+
+struct fix_job_s
+{
+	fix_job_fn fn;
+	void *arg;
+	int *counter; //Optional, incremented on submit and decremented once the job has run
+};
+
+typedef struct fix_job_s fix_job;
+
+struct fix_jobs_s;
+
+struct fix_jobs_worker_s
+{
+	fix_wsdeque deque;
+	struct fix_jobs_s *pool;
+	unsigned int index;
+	unsigned int seed; //Picks which worker to steal from
+	pthread_t thread;
+};
+
+typedef struct fix_jobs_worker_s fix_jobs_worker;
+
+struct fix_jobs_s
+{
+	fix_jobs_worker workers[FIX_JOBS_WORKERS_MAX];
+	unsigned int worker_count;
+	fix_mpmc inject;
+	fix_mpmc_cell inject_cells[FIX_JOBS_INJECT_SIZE];
+	int pending; //Jobs submitted but not finished yet
+	int queued; //Jobs submitted but not started yet
+	int sleepers;
+	int running;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+};
+
+typedef struct fix_jobs_s fix_jobs;
+
+int fix_jobs_init(fix_jobs *pool, unsigned int worker_count);
+void fix_jobs_destroy(fix_jobs *pool);
+void fix_jobs_submit(fix_jobs *pool, fix_job *job);
+void fix_jobs_wait(fix_jobs *pool);
+void fix_jobs_wait_counter(fix_jobs *pool, int *counter);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //FIX_JOBS_H
+
+
+#if defined(FIX_JOBS_IMPL) && !defined(FIX_JOBS_IMPL_DONE)
+#define FIX_JOBS_IMPL_DONE
+
+#include <sched.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif //_cplusplus
+
+#ifndef FIX_JOBS_THREAD_LOCAL
+#if defined(__cplusplus)
+#define FIX_JOBS_THREAD_LOCAL thread_local
+#else
+#define FIX_JOBS_THREAD_LOCAL _Thread_local
+#endif
+#endif //FIX_JOBS_THREAD_LOCAL
+
+// The worker running on this thread, NULL on threads outside of any pool
+static FIX_JOBS_THREAD_LOCAL fix_jobs_worker *fix_jobs_current;
+// Picks which worker to steal from on threads outside of the pool, seeded on first use
+static FIX_JOBS_THREAD_LOCAL unsigned int fix_jobs_outside_seed;
+
+// Runs the job and marks it as done
+static void fix_jobs_finish(fix_jobs *pool, fix_job *job)
+{
+	int *counter = job->counter; //The job may be gone once the counter drops
+	job->fn(job->arg);
+	if(counter) __atomic_fetch_sub(counter, 1, __ATOMIC_RELEASE);
+	__atomic_fetch_sub(&pool->pending, 1, __ATOMIC_RELEASE);
+}
+
+// Finds a job for `self` (NULL if the caller isn't a worker of the pool) and runs it. Returns 0 if there was none.
+static int fix_jobs_run_one(fix_jobs *pool, fix_jobs_worker *self)
+{
+	void *job = 0;
+	int found = self && fix_wsdeque_pop(&self->deque, &job);
+	if(!found) found = fix_mpmc_dequeue(&pool->inject, &job);
+
+	if(!found)
+	{
+		unsigned int *seed = self ? &self->seed : &fix_jobs_outside_seed;
+		//Every thread's copy sits at a different address, so outside threads don't all start at the same victim
+		if(!*seed) *seed = (unsigned int)((size_t)seed >> 4) | 1u;
+		*seed = *seed * 1103515245u + 12345u;
+		unsigned int start = *seed >> 16;
+		for(unsigned int i = 0; i < pool->worker_count && !found; ++i)
+		{
+			fix_jobs_worker *victim = &pool->workers[(start + i) % pool->worker_count];
+			if(victim != self) found = fix_wsdeque_steal(&victim->deque, &job);
+		}
+	}
+	if(!found) return 0;
+
+	__atomic_fetch_sub(&pool->queued, 1, __ATOMIC_SEQ_CST);
+	fix_jobs_finish(pool, (fix_job *)job);
+	return 1;
+}
+
+static void *fix_jobs_worker_main(void *arg)
+{
+	fix_jobs_worker *self = (fix_jobs_worker *)arg;
+	fix_jobs *pool = self->pool;
+	fix_jobs_current = self;
+
+	while(__atomic_load_n(&pool->running, __ATOMIC_ACQUIRE))
+	{
+		if(fix_jobs_run_one(pool, self)) continue;
+
+		//Nothing to do, spin a little before going to sleep
+		int idle = 0;
+		while(idle < 64 && !__atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE))
+		{
+			sched_yield();
+			idle += 1;
+		}
+		if(idle < 64) continue;
+
+		pthread_mutex_lock(&pool->lock);
+		__atomic_fetch_add(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+		while(!__atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) && __atomic_load_n(&pool->running, __ATOMIC_ACQUIRE))
+		{
+			pthread_cond_wait(&pool->wake, &pool->lock);
+		}
+		__atomic_fetch_sub(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	fix_jobs_current = 0;
+	return 0;
+}
+
+static void fix_jobs_stop(fix_jobs *pool, unsigned int started);
+
+// Starts `worker_count` worker threads, one per core if it's 0. Returns 0 if anything fails to start.
+int fix_jobs_init(fix_jobs *pool, unsigned int worker_count)
+{
+	if(worker_count == 0)
+	{
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		worker_count = cores > 0 ? (unsigned int)cores : 1;
+	}
+	if(worker_count > FIX_JOBS_WORKERS_MAX) worker_count = FIX_JOBS_WORKERS_MAX;
+
+	if(!fix_mpmc_init(&pool->inject, pool->inject_cells, FIX_JOBS_INJECT_SIZE)) return 0;
+	pool->worker_count = 0;
+	pool->pending = 0;
+	pool->queued = 0;
+	pool->sleepers = 0;
+	pool->running = 1;
+	pthread_mutex_init(&pool->lock, 0);
+	pthread_cond_init(&pool->wake, 0);
+
+	//Set up every deque before any worker starts stealing from it
+	for(unsigned int i = 0; i < worker_count; ++i)
+	{
+		fix_jobs_worker *worker = &pool->workers[i];
+		if(!fix_wsdeque_init(&worker->deque, FIX_JOBS_DEQUE_SIZE))
+		{
+			while(i--) fix_wsdeque_destroy(&pool->workers[i].deque);
+			pthread_cond_destroy(&pool->wake);
+			pthread_mutex_destroy(&pool->lock);
+			return 0;
+		}
+		worker->pool = pool;
+		worker->index = i;
+		worker->seed = i + 1;
+	}
+	pool->worker_count = worker_count;
+
+	for(unsigned int i = 0; i < worker_count; ++i)
+	{
+		if(pthread_create(&pool->workers[i].thread, 0, fix_jobs_worker_main, &pool->workers[i]) == 0) continue;
+
+		//Stop the workers that did start, they only ever saw an empty pool
+		fix_jobs_stop(pool, i);
+		return 0;
+	}
+	return 1;
+}
+
+// Stops and joins the first `started` workers, then frees everything
+static void fix_jobs_stop(fix_jobs *pool, unsigned int started)
+{
+	pthread_mutex_lock(&pool->lock);
+	__atomic_store_n(&pool->running, 0, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	//Every worker has to be gone before any deque is freed, they steal from each other until the end
+	for(unsigned int i = 0; i < started; ++i) pthread_join(pool->workers[i].thread, 0);
+	for(unsigned int i = 0; i < pool->worker_count; ++i) fix_wsdeque_destroy(&pool->workers[i].deque);
+
+	pthread_cond_destroy(&pool->wake);
+	pthread_mutex_destroy(&pool->lock);
+	pool->worker_count = 0;
+}
+
+// Stops and joins every worker. Call `fix_jobs_wait` first, jobs that haven't run yet are dropped.
+void fix_jobs_destroy(fix_jobs *pool)
+{
+	fix_jobs_stop(pool, pool->worker_count);
+}
+
+// Queues the job to run on one of the workers. The job has to stay alive until it has run.
+void fix_jobs_submit(fix_jobs *pool, fix_job *job)
+{
+	if(job->counter) __atomic_fetch_add(job->counter, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&pool->pending, 1, __ATOMIC_RELAXED);
+	//Counted before it's visible, so a worker can't take it while `queued` still reads 0
+	__atomic_fetch_add(&pool->queued, 1, __ATOMIC_SEQ_CST);
+
+	fix_jobs_worker *self = fix_jobs_current;
+	int queued = self && self->pool == pool ? fix_wsdeque_push(&self->deque, job) : 0;
+	if(!queued) queued = fix_mpmc_enqueue(&pool->inject, job);
+	if(!queued)
+	{
+		__atomic_fetch_sub(&pool->queued, 1, __ATOMIC_SEQ_CST);
+		fix_jobs_finish(pool, job);
+		return;
+	}
+
+	if(__atomic_load_n(&pool->sleepers, __ATOMIC_SEQ_CST))
+	{
+		pthread_mutex_lock(&pool->lock);
+		pthread_cond_signal(&pool->wake);
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+// Returns once every submitted job has finished, running jobs on the calling thread in the meantime. Not from inside a job.
+void fix_jobs_wait(fix_jobs *pool)
+{
+	fix_jobs_wait_counter(pool, &pool->pending);
+}
+
+// Returns once every job submitted with `counter` has finished, running jobs on the calling thread in the meantime
+void fix_jobs_wait_counter(fix_jobs *pool, int *counter)
+{
+	fix_jobs_worker *self = fix_jobs_current;
+	if(self && self->pool != pool) self = 0;
+
+	while(__atomic_load_n(counter, __ATOMIC_ACQUIRE))
+	{
+		if(!fix_jobs_run_one(pool, self)) sched_yield();
+	}
+}
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //FIX_JOBS_IMPL
@@ -0,0 +1,157 @@
+/* fix_lfstack.h
+* License: Public Domain or zlib
+*
+* To use this library, remember to define FIX_LFSTACK_IMPL in ONE C or C++ file:
+* #define FIX_LFSTACK_IMPL
+* #include "fix_lfstack.h"
+*
+* Lock-free intrusive stack (Treiber stack)
+*
+* `fix_lfstack` is a stack for any number of threads, meant for recycling objects: embed a `fix_lfstack_node` in them
+* and push/pop that. It doesn't store or allocate anything itself.
+* The head is a {node, tag} pair swapped with a double-word CAS, and every pop bumps the tag, so a node that got popped
+* and pushed back in between (the ABA problem) can't fool it.
+*
+* It needs GCC or Clang (`__atomic` builtins, `__attribute__((aligned))`). On 64-bit the double-word load and CAS are 16 bytes,
+* which GCC always routes through libatomic: link with -latomic, and build with -mcx16 on x86-64 so libatomic
+* (or Clang, inline) can use cmpxchg16b and stay lock-free. That's why it lives in its own header.
+*
+* A popping thread may still read the `next` of a node another thread just popped, so nodes have to stay readable
+* memory while the stack is in use (pool or freelist memory is fine, memory handed back to the OS isn't).
+*
+* Example Usage:
+* struct job {fix_lfstack_node link; int data;};
+* fix_lfstack free_jobs;
+* fix_lfstack_init(&free_jobs);
+* fix_lfstack_push(&free_jobs, &job->link);
+* struct job *j = (struct job *)fix_lfstack_pop(&free_jobs); //`link` is the first member
+*/
+
+#ifndef FIX_LFSTACK_H
+#define FIX_LFSTACK_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif //_cplusplus
+
+//Needed for size_t
+#include <stddef.h>
+
+#ifndef FIX_LFSTACK_CACHE_LINE
+#define FIX_LFSTACK_CACHE_LINE 64
+#endif //FIX_LFSTACK_CACHE_LINE
+
+struct fix_lfstack_node_s
+{
+	struct fix_lfstack_node_s *next;
+};
+
+typedef struct fix_lfstack_node_s fix_lfstack_node;
+
+//Aligned to its size so it can be swapped with a single double-word CAS
+struct fix_lfstack_head_s
+{
+	fix_lfstack_node *node;
+	size_t tag; //Bumped on every pop
+} __attribute__((aligned(2 * sizeof(void *))));
+
+typedef struct fix_lfstack_head_s fix_lfstack_head;
+
+struct fix_lfstack_s
+{
+	fix_lfstack_head head;
+	unsigned char pad[FIX_LFSTACK_CACHE_LINE];
+};
+
+typedef struct fix_lfstack_s fix_lfstack;
+
+void fix_lfstack_init(fix_lfstack *s);
+void fix_lfstack_push(fix_lfstack *s, fix_lfstack_node *node);
+void fix_lfstack_push_chain(fix_lfstack *s, fix_lfstack_node *first, fix_lfstack_node *last);
+fix_lfstack_node *fix_lfstack_pop(fix_lfstack *s);
+fix_lfstack_node *fix_lfstack_pop_all(fix_lfstack *s);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //FIX_LFSTACK_H
+
+
+#if defined(FIX_LFSTACK_IMPL) && !defined(FIX_LFSTACK_IMPL_DONE)
+#define FIX_LFSTACK_IMPL_DONE
+
+#ifdef __cplusplus
+extern "C"{
+#endif //_cplusplus
+
+// Reads the node and the tag together in one double-word load. Reading them one at a time isn't safe: the node could be
+// popped and pushed back between the two reads, pairing it with a newer tag, and a pop's CAS would then succeed with a stale `next`.
+static void fix_lfstack_load(fix_lfstack *s, fix_lfstack_head *head)
+{
+	__atomic_load(&s->head, head, __ATOMIC_ACQUIRE);
+}
+
+// Has to happen before any thread starts using the stack
+void fix_lfstack_init(fix_lfstack *s)
+{
+	s->head.node = 0;
+	s->head.tag = 0;
+}
+
+void fix_lfstack_push(fix_lfstack *s, fix_lfstack_node *node)
+{
+	fix_lfstack_push_chain(s, node, node);
+}
+
+// Pushes a chain of nodes already linked through `next`, from `first` to `last`, with a single CAS.
+// `first` ends up on top.
+void fix_lfstack_push_chain(fix_lfstack *s, fix_lfstack_node *first, fix_lfstack_node *last)
+{
+	fix_lfstack_head old, new_head;
+	fix_lfstack_load(s, &old);
+	do
+	{
+		__atomic_store_n(&last->next, old.node, __ATOMIC_RELAXED);
+		new_head.node = first;
+		new_head.tag = old.tag;
+	} while(!__atomic_compare_exchange(&s->head, &old, &new_head, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+}
+
+// Returns NULL if the stack is empty
+fix_lfstack_node *fix_lfstack_pop(fix_lfstack *s)
+{
+	fix_lfstack_head old, new_head;
+	fix_lfstack_load(s, &old);
+	do
+	{
+		if(!old.node) return 0;
+
+		new_head.node = __atomic_load_n(&old.node->next, __ATOMIC_RELAXED);
+		new_head.tag = old.tag + 1;
+	} while(!__atomic_compare_exchange(&s->head, &old, &new_head, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+	return old.node;
+}
+
+// Empties the stack in one go, returns the whole chain (top first, linked through `next`) or NULL if it was empty
+fix_lfstack_node *fix_lfstack_pop_all(fix_lfstack *s)
+{
+	fix_lfstack_head old, new_head;
+	fix_lfstack_load(s, &old);
+	do
+	{
+		if(!old.node) return 0;
+
+		new_head.node = 0;
+		new_head.tag = old.tag + 1;
+	} while(!__atomic_compare_exchange(&s->head, &old, &new_head, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+	return old.node;
+}
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //FIX_LFSTACK_IMPL
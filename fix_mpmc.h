@@ -0,0 +1,160 @@
+/* fix_mpmc.h
+* License: Public Domain or zlib
+*
+* To use this library, remember to define FIX_MPMC_IMPL in ONE C or C++ file:
+* #define FIX_MPMC_IMPL
+* #include "fix_mpmc.h"
+*
+* Lock-free multi-producer multi-consumer queue
+*
+* `fix_mpmc` is a bounded queue of pointers for any number of producer and consumer threads (Dmitry Vyukov's design).
+* Every cell carries a sequence number telling whether it's ready to be written or read in the current lap,
+* so producers and consumers only contend on their own index, with a single CAS per operation.
+* Its storage is an array of `fix_mpmc_cell` instead of pointers, with a power-of-two capacity. The storage is yours
+* (or comes from a `fix_arena`, if fix_arena.h is included before the implementation).
+*
+* It needs GCC or Clang for the `__atomic` builtins, which is why it lives in its own header.
+*
+* Example Usage:
+* fix_mpmc_cell cells[256];
+* fix_mpmc q;
+* fix_mpmc_init(&q, cells, 256);
+* fix_mpmc_enqueue(&q, item); //Any thread
+* while(fix_mpmc_dequeue(&q, &item)) {...} //Any thread
+*/
+
+#ifndef FIX_MPMC_H
+#define FIX_MPMC_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif //_cplusplus
+
+#ifndef FIX_MPMC_CACHE_LINE
+#define FIX_MPMC_CACHE_LINE 64
+#endif //FIX_MPMC_CACHE_LINE
+
+struct fix_mpmc_cell_s
+{
+	unsigned int sequence;
+	void *item;
+};
+
+typedef struct fix_mpmc_cell_s fix_mpmc_cell;
+
+struct fix_mpmc_s
+{
+	fix_mpmc_cell *cells;
+	unsigned int mask;
+	unsigned char pad0[FIX_MPMC_CACHE_LINE];
+	unsigned int tail; //Shared by the producers
+	unsigned char pad1[FIX_MPMC_CACHE_LINE];
+	unsigned int head; //Shared by the consumers
+	unsigned char pad2[FIX_MPMC_CACHE_LINE];
+};
+
+typedef struct fix_mpmc_s fix_mpmc;
+
+int fix_mpmc_init(fix_mpmc *q, fix_mpmc_cell *buffer, unsigned int capacity);
+#ifdef FIX_ARENA_H
+int fix_mpmc_arena_init(fix_mpmc *q, fix_arena *arena, unsigned int capacity);
+#endif //FIX_ARENA_H
+int fix_mpmc_enqueue(fix_mpmc *q, void *item);
+int fix_mpmc_dequeue(fix_mpmc *q, void **item);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //FIX_MPMC_H
+
+
+#if defined(FIX_MPMC_IMPL) && !defined(FIX_MPMC_IMPL_DONE)
+#define FIX_MPMC_IMPL_DONE
+
+#ifdef __cplusplus
+extern "C"{
+#endif //_cplusplus
+
+// Sets the buffer as the queue's storage. `capacity` has to be a power of two (and at least 2), returns 0 if it isn't.
+// Has to happen before any thread starts using the queue.
+int fix_mpmc_init(fix_mpmc *q, fix_mpmc_cell *buffer, unsigned int capacity)
+{
+	if(capacity < 2 || (capacity & (capacity - 1))) return 0;
+
+	for(unsigned int i = 0; i < capacity; ++i)
+	{
+		buffer[i].sequence = i;
+	}
+
+	q->cells = buffer;
+	q->mask = capacity - 1;
+	q->tail = 0;
+	q->head = 0;
+	return 1;
+}
+
+#ifdef FIX_ARENA_H
+// Allocates the queue's storage from the arena. Returns 0 if the capacity isn't a power of two or the arena is out of memory.
+int fix_mpmc_arena_init(fix_mpmc *q, fix_arena *arena, unsigned int capacity)
+{
+	if(capacity < 2 || (capacity & (capacity - 1))) return 0;
+
+	fix_mpmc_cell *buffer = fix_arena_push_array(arena, fix_mpmc_cell, capacity);
+	if(!buffer) return 0;
+
+	return fix_mpmc_init(q, buffer, capacity);
+}
+#endif //FIX_ARENA_H
+
+// Returns 0 if the queue is full
+int fix_mpmc_enqueue(fix_mpmc *q, void *item)
+{
+	unsigned int pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+	fix_mpmc_cell *cell;
+	for(;;)
+	{
+		cell = &q->cells[pos & q->mask];
+		int diff = (int)(__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - pos);
+		if(diff == 0)
+		{
+			//The cell is free in this lap, claim it. On failure `pos` is updated to the current tail.
+			if(__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+		}
+		else if(diff < 0) return 0; //Still holds an item from the previous lap
+		else pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED); //Another producer got it first
+	}
+
+	cell->item = item;
+	__atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+// Returns 0 if the queue is empty, `item` is left untouched then
+int fix_mpmc_dequeue(fix_mpmc *q, void **item)
+{
+	unsigned int pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+	fix_mpmc_cell *cell;
+	for(;;)
+	{
+		cell = &q->cells[pos & q->mask];
+		int diff = (int)(__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - (pos + 1));
+		if(diff == 0)
+		{
+			if(__atomic_compare_exchange_n(&q->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+		}
+		else if(diff < 0) return 0; //Nothing was written to it in this lap yet
+		else pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+	}
+
+	*item = cell->item;
+	//Free the cell for the producers of the next lap
+	__atomic_store_n(&cell->sequence, pos + q->mask + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //FIX_MPMC_IMPL
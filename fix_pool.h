@@ -0,0 +1,241 @@
+/* fix_pool.h
+* License: Public Domain or zlib
+*
+* To use this library, just include it in one C or C++ file:
+* #include "fix_pool.h"
+*
+* Fixed-Size Object Pool Allocator
+*
+* NOTES:
+* All functions are declared `static inline` since they don't do anything complex
+* The pool doesn't malloc, you're in charge of providing the buffer. `fix_pool_buffer_size` tells you how big it has to be.
+* If fix_arena.h is included BEFORE fix_pool.h, `fix_pool_arena_init` can carve the buffer out of a `fix_arena` instead.
+*
+* Every slot has the same size, and free slots are linked through their own memory, so objects carry no header
+* and `alloc` / `free` are O(1). Slots are at least `sizeof(void*)` big and aligned to it, or to the type's alignment
+* if that's bigger: the `_type` versions take care of it, use `fix_pool_init_aligned` for over-aligned raw sizes.
+* The buffer has to be aligned just as much (malloc'ed memory, or `_Alignas` / `alignas` on the array).
+* Slots that were never handed out aren't linked at all, so `init` and `free_all` don't touch the buffer.
+*
+* Handles are optional: call `fix_pool_handles_init` with an array of `capacity` generation counters, then use
+* the `*_handle` functions. A handle remembers the generation of its slot, so using it after the object was freed
+* (even if the slot was reused since) returns NULL instead of someone else's object.
+*
+* Example Usage:
+* struct particle {float x, y, vx, vy;};
+* _Alignas(struct particle) unsigned char buffer[fix_pool_buffer_size_type(struct particle, 256)];
+* fix_pool pool;
+* fix_pool_init_type(&pool, struct particle, 256, buffer);
+* struct particle *p = fix_pool_alloc_type(&pool, struct particle);
+* fix_pool_free(&pool, p);
+*/
+
+#ifndef FIX_POOL_H
+#define FIX_POOL_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif //_cplusplus
+
+//Needed for NULL
+#include <stddef.h>
+
+struct fix_pool_s
+{
+	unsigned char *memory;
+	unsigned int slot_size;
+	unsigned int capacity;
+	unsigned int used; //How many objects are currently allocated
+	unsigned int bump; //Slots from here on have never been handed out since the last `free_all`
+	void *free_list; //Freed slots, each one starts with a pointer to the next
+	unsigned int *generations; //NULL unless handles are enabled. Odd while the slot is allocated.
+};
+typedef struct fix_pool_s fix_pool;
+
+struct fix_pool_handle_s
+{
+	unsigned int index;
+	unsigned int generation;
+};
+typedef struct fix_pool_handle_s fix_pool_handle;
+
+#ifndef FIX_POOL_ALIGNOF
+#ifdef __cplusplus
+#define FIX_POOL_ALIGNOF(T) alignof(T)
+#else
+#define FIX_POOL_ALIGNOF(T) _Alignof(T)
+#endif //__cplusplus
+#endif //FIX_POOL_ALIGNOF
+
+//Alignment of the slots, at least that of the free-list link
+#define fix_pool_slot_align(align) ((align) < sizeof(void *) ? (unsigned int)sizeof(void *) : (unsigned int)(align))
+//Size of a slot able to hold `size` bytes and a free-list link, keeping every slot aligned to `align` (a power of two)
+#define fix_pool_slot_size_aligned(size, align) ((unsigned int)((((size) < sizeof(void *) ? sizeof(void *) : (size)) + fix_pool_slot_align(align) - 1) & ~(fix_pool_slot_align(align) - 1)))
+#define fix_pool_slot_size(size) fix_pool_slot_size_aligned((size), sizeof(void *))
+//Size of the buffer a pool of `capacity` objects of `size` bytes needs
+#define fix_pool_buffer_size(size, capacity) (fix_pool_slot_size(size) * (capacity))
+#define fix_pool_buffer_size_aligned(size, align, capacity) (fix_pool_slot_size_aligned((size), (align)) * (capacity))
+#define fix_pool_buffer_size_type(T, capacity) fix_pool_buffer_size_aligned(sizeof(T), FIX_POOL_ALIGNOF(T), (capacity))
+
+//Sets the buffer as the pool's memory, with slots aligned to `align` (a power of two).
+//The buffer has to be aligned to `align` and at least `fix_pool_buffer_size_aligned(slot_size, align, capacity)` bytes.
+static inline void fix_pool_init_aligned(fix_pool *pool, unsigned int slot_size, unsigned int align, unsigned int capacity, unsigned char *buffer)
+{
+	pool->memory = buffer;
+	pool->slot_size = fix_pool_slot_size_aligned(slot_size, align);
+	pool->capacity = capacity;
+	pool->used = 0;
+	pool->bump = 0;
+	pool->free_list = NULL;
+	pool->generations = NULL;
+}
+
+//Sets the buffer as the pool's memory. It has to be at least `fix_pool_buffer_size(slot_size, capacity)` bytes.
+static inline void fix_pool_init(fix_pool *pool, unsigned int slot_size, unsigned int capacity, unsigned char *buffer)
+{
+	fix_pool_init_aligned(pool, slot_size, sizeof(void *), capacity, buffer);
+}
+
+#define fix_pool_init_type(pool, T, capacity, buffer) fix_pool_init_aligned((pool), sizeof(T), FIX_POOL_ALIGNOF(T), (capacity), (buffer))
+
+#ifdef FIX_ARENA_H
+//Allocates the pool's memory from the arena, with slots aligned to `align`. Returns 0 if the arena doesn't have enough memory left.
+static inline int fix_pool_arena_init_aligned(fix_pool *pool, unsigned int slot_size, unsigned int align, unsigned int capacity, fix_arena *arena)
+{
+	unsigned char *buffer = (unsigned char *)fix_arena_malloc_aligned(arena, fix_pool_buffer_size_aligned(slot_size, align, capacity), fix_pool_slot_align(align));
+	if(!buffer) return 0;
+
+	fix_pool_init_aligned(pool, slot_size, align, capacity, buffer);
+	return 1;
+}
+
+//Allocates the pool's memory from the arena. Returns 0 if the arena doesn't have enough memory left.
+static inline int fix_pool_arena_init(fix_pool *pool, unsigned int slot_size, unsigned int capacity, fix_arena *arena)
+{
+	return fix_pool_arena_init_aligned(pool, slot_size, sizeof(void *), capacity, arena);
+}
+
+#define fix_pool_arena_init_type(pool, T, capacity, arena) fix_pool_arena_init_aligned((pool), sizeof(T), FIX_POOL_ALIGNOF(T), (capacity), (arena))
+#endif //FIX_ARENA_H
+
+//Sets all pool info to zero, doesn't destroy the memory
+static inline void fix_pool_destroy(fix_pool *pool)
+{
+	pool->slot_size = 0;
+	pool->capacity = 0;
+	pool->used = 0;
+	pool->bump = 0;
+	pool->free_list = NULL;
+	pool->generations = NULL;
+}
+
+//Allocates a slot. If the pool is full, NULL is returned.
+static inline void *fix_pool_alloc(fix_pool *pool)
+{
+	void *mem = pool->free_list;
+	if(mem)
+	{
+		pool->free_list = *(void **)mem;
+	}
+	else
+	{
+		if(pool->bump == pool->capacity) return NULL;
+		mem = &pool->memory[pool->bump * pool->slot_size];
+		pool->bump += 1;
+	}
+
+	pool->used += 1;
+	return mem;
+}
+
+#define fix_pool_alloc_type(pool, T) ((T *)fix_pool_alloc(pool))
+
+//Puts the slot back into the pool. Doesn't zero it. Handles to it become stale.
+static inline void fix_pool_free(fix_pool *pool, void *mem)
+{
+	if(pool->generations)
+	{
+		unsigned int index = (unsigned int)(((unsigned char *)mem - pool->memory) / pool->slot_size);
+		if(pool->generations[index] & 1) pool->generations[index] += 1;
+	}
+
+	*(void **)mem = pool->free_list;
+	pool->free_list = mem;
+	pool->used -= 1;
+}
+
+//Treats every slot as free. Outstanding handles become stale.
+static inline void fix_pool_free_all(fix_pool *pool)
+{
+	if(pool->generations)
+	{
+		for(unsigned int i = 0; i < pool->bump; ++i)
+		{
+			if(pool->generations[i] & 1) pool->generations[i] += 1;
+		}
+	}
+
+	pool->used = 0;
+	pool->bump = 0;
+	pool->free_list = NULL;
+}
+
+//Returns the slot index of a pointer handed out by the pool
+static inline unsigned int fix_pool_index_of(fix_pool *pool, void *mem)
+{
+	return (unsigned int)(((unsigned char *)mem - pool->memory) / pool->slot_size);
+}
+
+//Returns the slot at `index`
+static inline void *fix_pool_at(fix_pool *pool, unsigned int index)
+{
+	return &pool->memory[index * pool->slot_size];
+}
+
+// Handles
+
+//Enables handles. `generations` has to hold `capacity` counters, call this before allocating anything.
+static inline void fix_pool_handles_init(fix_pool *pool, unsigned int *generations)
+{
+	pool->generations = generations;
+	for(unsigned int i = 0; i < pool->capacity; ++i) generations[i] = 0;
+}
+
+//Allocates a slot and writes its handle out. If the pool is full, NULL is returned.
+static inline void *fix_pool_alloc_handle(fix_pool *pool, /* out */ fix_pool_handle *handle)
+{
+	void *mem = fix_pool_alloc(pool);
+	if(!mem) return NULL;
+
+	unsigned int index = fix_pool_index_of(pool, mem);
+	pool->generations[index] += 1;
+
+	handle->index = index;
+	handle->generation = pool->generations[index];
+	return mem;
+}
+
+//Returns the object behind the handle, NULL if it has been freed since
+static inline void *fix_pool_get(fix_pool *pool, fix_pool_handle handle)
+{
+	if(handle.index >= pool->bump || pool->generations[handle.index] != handle.generation || !(handle.generation & 1)) return NULL;
+	return fix_pool_at(pool, handle.index);
+}
+
+#define fix_pool_get_type(pool, T, handle) ((T *)fix_pool_get((pool), (handle)))
+
+//Frees the object behind the handle. Returns 0 if the handle was stale and nothing was freed.
+static inline int fix_pool_free_handle(fix_pool *pool, fix_pool_handle handle)
+{
+	void *mem = fix_pool_get(pool, handle);
+	if(!mem) return 0;
+
+	fix_pool_free(pool, mem);
+	return 1;
+}
+
+#ifdef __cplusplus
+}
+#endif //_cplusplus
+
+#endif //FIX_POOL_H
@@ -12,11 +12,28 @@
 *
 * Define a custom FIX_QUEUE_SIZE_MAX during compile-time if you want a bigger or smaller queue size.
 * Define FIX_QUEUE_ZERO_INIT if you really want to set all pointers to 0x0.
+*
+* `fix_ring` is a ring buffer of pointers with its capacity picked at runtime. The capacity has to be a power of two,
+* so indices wrap with a mask instead of a modulo. Head and tail run freely and only get masked on access,
+* so a full ring and an empty ring never look the same. The storage is yours (or comes from a `fix_arena`,
+* if fix_arena.h is included before the implementation). Enqueue and dequeue tell you when the ring is full or empty,
+* and the bulk versions move as many items as fit with at most two memcpys.
+*
+* For the same ring shared lock-free between one producer and one consumer thread, see fix_spsc.h.
+* For a bounded queue shared between any number of producer and consumer threads, see fix_mpmc.h.
+*
+* `fix_queue_typed(T)` stores the items themselves rather than pointers to them, so small items (events, job descriptors...)
+* don't need an allocation each. It's a power-of-two ring like `fix_ring`, driven by macros. Items are copied by assignment,
+* the bulk versions memcpy. In C++, `fix_typed_queue<T>` does the same for any type: items are constructed in place,
+* moved in and out, and destroyed when dequeued, and trivially copyable types still take the memcpy path in bulk.
 */
 
 #ifndef FIX_QUEUE_H
 #define FIX_QUEUE_H
 
+//Needed for size_t
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C"{
 #endif //_cplusplus
@@ -34,15 +51,159 @@ struct fix_queue_s
 
 typedef struct fix_queue_s fix_queue;
 
+struct fix_ring_s
+{
+	void **items;
+	unsigned int mask; //Capacity - 1
+	unsigned int head; //Next item to dequeue, never wrapped
+	unsigned int tail; //Next free slot, never wrapped
+};
+
+typedef struct fix_ring_s fix_ring;
+
+int fix_ring_init(fix_ring *r, void **buffer, unsigned int capacity);
+#ifdef FIX_ARENA_H
+int fix_ring_arena_init(fix_ring *r, fix_arena *arena, unsigned int capacity);
+#endif //FIX_ARENA_H
+void fix_ring_clear(fix_ring *r);
+unsigned int fix_ring_count(fix_ring *r);
+unsigned int fix_ring_capacity(fix_ring *r);
+int fix_ring_enqueue(fix_ring *r, void *item);
+int fix_ring_dequeue(fix_ring *r, void **item);
+unsigned int fix_ring_enqueue_bulk(fix_ring *r, void **items, unsigned int count);
+unsigned int fix_ring_dequeue_bulk(fix_ring *r, void **items, unsigned int count);
+
+// Typed queue
+// Example Usage:
+// struct event {int type; float x, y;};
+// struct event storage[64];
+// fix_queue_typed(struct event) events;
+// fix_queue_typed_init(events, storage, 64);
+// fix_queue_typed_enqueue(events, e);
+// while(fix_queue_typed_dequeue(events, &e)) {...}
+
+#define fix_queue_typed(T) struct { T *data; unsigned int mask; unsigned int head; unsigned int tail; }
+//Evaluates to 0 if `capacity` isn't a power of two
+#define fix_queue_typed_init(q, buffer, capacity) (((capacity) == 0 || ((capacity) & ((capacity) - 1))) ? 0 : ((q).data = (buffer), (q).mask = (capacity) - 1, (q).head = 0, (q).tail = 0, 1))
+#define fix_queue_typed_clear(q) ((q).head = 0, (q).tail = 0)
+#define fix_queue_typed_count(q) ((q).tail - (q).head)
+#define fix_queue_typed_capacity(q) ((q).mask + 1)
+//Evaluates to 0 if the queue is full
+#define fix_queue_typed_enqueue(q, item) ((q).tail - (q).head > (q).mask ? 0 : ((q).data[(q).tail & (q).mask] = (item), (q).tail += 1, 1))
+//Copies the front item to `*out` and evaluates to 1, or to 0 if the queue is empty
+#define fix_queue_typed_dequeue(q, out) ((q).tail == (q).head ? 0 : (*(out) = (q).data[(q).head & (q).mask], (q).head += 1, 1))
+//Enqueues as many of the `count` items as fit, evaluates to how many it did
+#define fix_queue_typed_enqueue_bulk(q, items, count) fix_queue_typed_copy_in((q).data, (q).mask, (q).head, &(q).tail, (items), (count), sizeof(*(q).data))
+//Dequeues up to `count` items into `out`, evaluates to how many it did
+#define fix_queue_typed_dequeue_bulk(q, out, count) fix_queue_typed_copy_out((q).data, (q).mask, &(q).head, (q).tail, (out), (count), sizeof(*(q).data))
+
+unsigned int fix_queue_typed_copy_in(void *data, unsigned int mask, unsigned int head, unsigned int *tail, const void *items, unsigned int count, size_t item_size);
+unsigned int fix_queue_typed_copy_out(const void *data, unsigned int mask, unsigned int *head, unsigned int tail, void *items, unsigned int count, size_t item_size);
+
 #ifdef __cplusplus
 }
 #endif //__cplusplus
 
+#ifdef __cplusplus
+#include <new>
+#include <utility>
+#include <type_traits>
+
+// Typed queue for C++, works with any movable type. Like everything else here, it doesn't allocate:
+// `init` takes storage for `capacity` items, suitably aligned (e.g. `alignas(T) unsigned char buffer[sizeof(T) * capacity]`).
+// Items still queued are destroyed along with the queue.
+template <typename T>
+struct fix_typed_queue
+{
+	T *data = nullptr;
+	unsigned int mask = 0;
+	unsigned int head = 0;
+	unsigned int tail = 0;
+
+	fix_typed_queue() = default;
+	fix_typed_queue(const fix_typed_queue &) = delete;
+	fix_typed_queue &operator=(const fix_typed_queue &) = delete;
+	~fix_typed_queue() { clear(); }
+
+	// Returns false if `capacity` isn't a power of two
+	bool init(void *buffer, unsigned int capacity)
+	{
+		if(capacity == 0 || (capacity & (capacity - 1))) return false;
+
+		clear();
+		data = static_cast<T *>(buffer);
+		mask = capacity - 1;
+		return true;
+	}
+
+	// Destroys every queued item
+	void clear()
+	{
+		for(; head != tail; ++head) data[head & mask].~T();
+		head = 0;
+		tail = 0;
+	}
+
+	unsigned int count() const { return tail - head; }
+	unsigned int capacity() const { return mask + 1; }
+
+	// Constructs an item in place at the back. Returns false if the queue is full.
+	template <typename... Args>
+	bool emplace(Args &&...args)
+	{
+		if(tail - head > mask) return false;
+
+		new (&data[tail & mask]) T(std::forward<Args>(args)...);
+		tail += 1;
+		return true;
+	}
+
+	bool enqueue(const T &item) { return emplace(item); }
+	bool enqueue(T &&item) { return emplace(std::move(item)); }
+
+	// Moves the front item into `out`. Returns false if the queue is empty.
+	bool dequeue(T &out)
+	{
+		if(tail == head) return false;
+
+		T &item = data[head & mask];
+		out = std::move(item);
+		item.~T();
+		head += 1;
+		return true;
+	}
+
+	// Copies as many of the `n` items as fit, returns how many it did
+	unsigned int enqueue_bulk(const T *items, unsigned int n)
+	{
+		if(std::is_trivially_copyable<T>::value) return fix_queue_typed_copy_in(data, mask, head, &tail, items, n, sizeof(T));
+
+		unsigned int done = 0;
+		while(done < n && emplace(items[done])) ++done;
+		return done;
+	}
+
+	// Moves up to `n` items into `out`, returns how many it did
+	unsigned int dequeue_bulk(T *out, unsigned int n)
+	{
+		if(std::is_trivially_copyable<T>::value) return fix_queue_typed_copy_out(data, mask, &head, tail, out, n, sizeof(T));
+
+		unsigned int done = 0;
+		while(done < n && dequeue(out[done])) ++done;
+		return done;
+	}
+};
+#endif //__cplusplus
+
 #endif //FIX_QUEUE_H
 
 
 // Implementation Start
-#ifdef FIX_QUEUE_IMPL
+#if defined(FIX_QUEUE_IMPL) && !defined(FIX_QUEUE_IMPL_DONE)
+#define FIX_QUEUE_IMPL_DONE
+
+//Needed for memcpy
+#include <string.h>
 
 #ifdef __cplusplus
 extern "C"{
@@ -84,6 +245,136 @@ void *fix_queue_dequeue(fix_queue *q)
 	return item;
 }
 
+// Ring buffer
+
+// Sets the buffer as the ring's storage. `capacity` has to be a power of two, returns 0 if it isn't.
+int fix_ring_init(fix_ring *r, void **buffer, unsigned int capacity)
+{
+	if(capacity == 0 || (capacity & (capacity - 1))) return 0;
+
+	r->items = buffer;
+	r->mask = capacity - 1;
+	r->head = 0;
+	r->tail = 0;
+	return 1;
+}
+
+#ifdef FIX_ARENA_H
+// Allocates the ring's storage from the arena. Returns 0 if the capacity isn't a power of two or the arena is out of memory.
+int fix_ring_arena_init(fix_ring *r, fix_arena *arena, unsigned int capacity)
+{
+	if(capacity == 0 || (capacity & (capacity - 1))) return 0;
+
+	void **buffer = fix_arena_push_array(arena, void *, capacity);
+	if(!buffer) return 0;
+
+	return fix_ring_init(r, buffer, capacity);
+}
+#endif //FIX_ARENA_H
+
+// Empties the ring
+void fix_ring_clear(fix_ring *r)
+{
+	r->head = 0;
+	r->tail = 0;
+}
+
+unsigned int fix_ring_count(fix_ring *r)
+{
+	return r->tail - r->head;
+}
+
+unsigned int fix_ring_capacity(fix_ring *r)
+{
+	return r->mask + 1;
+}
+
+// Returns 0 if the ring is full
+int fix_ring_enqueue(fix_ring *r, void *item)
+{
+	if(r->tail - r->head > r->mask) return 0;
+
+	r->items[r->tail & r->mask] = item;
+	r->tail += 1;
+	return 1;
+}
+
+// Returns 0 if the ring is empty, `item` is left untouched then
+int fix_ring_dequeue(fix_ring *r, void **item)
+{
+	if(r->tail == r->head) return 0;
+
+	*item = r->items[r->head & r->mask];
+	r->head += 1;
+	return 1;
+}
+
+// Enqueues as many of the `count` items as fit, returns how many it did
+unsigned int fix_ring_enqueue_bulk(fix_ring *r, void **items, unsigned int count)
+{
+	unsigned int space = r->mask + 1 - (r->tail - r->head);
+	if(count > space) count = space;
+
+	unsigned int start = r->tail & r->mask;
+	unsigned int first = r->mask + 1 - start; //Slots left before wrapping around
+	if(first > count) first = count;
+
+	memcpy(&r->items[start], items, first * sizeof(void *));
+	memcpy(&r->items[0], items + first, (count - first) * sizeof(void *));
+	r->tail += count;
+	return count;
+}
+
+// Dequeues up to `count` items into `items`, returns how many it did
+unsigned int fix_ring_dequeue_bulk(fix_ring *r, void **items, unsigned int count)
+{
+	unsigned int available = r->tail - r->head;
+	if(count > available) count = available;
+
+	unsigned int start = r->head & r->mask;
+	unsigned int first = r->mask + 1 - start;
+	if(first > count) first = count;
+
+	memcpy(items, &r->items[start], first * sizeof(void *));
+	memcpy(items + first, &r->items[0], (count - first) * sizeof(void *));
+	r->head += count;
+	return count;
+}
+
+// Typed queue
+
+// Used by `fix_queue_typed_enqueue_bulk`, copies as many items in as fit with at most two memcpys
+unsigned int fix_queue_typed_copy_in(void *data, unsigned int mask, unsigned int head, unsigned int *tail, const void *items, unsigned int count, size_t item_size)
+{
+	unsigned int space = mask + 1 - (*tail - head);
+	if(count > space) count = space;
+
+	unsigned int start = *tail & mask;
+	unsigned int first = mask + 1 - start;
+	if(first > count) first = count;
+
+	memcpy((unsigned char *)data + start * item_size, items, first * item_size);
+	memcpy(data, (const unsigned char *)items + first * item_size, (count - first) * item_size);
+	*tail += count;
+	return count;
+}
+
+// Used by `fix_queue_typed_dequeue_bulk`, copies up to `count` items out with at most two memcpys
+unsigned int fix_queue_typed_copy_out(const void *data, unsigned int mask, unsigned int *head, unsigned int tail, void *items, unsigned int count, size_t item_size)
+{
+	unsigned int available = tail - *head;
+	if(count > available) count = available;
+
+	unsigned int start = *head & mask;
+	unsigned int first = mask + 1 - start;
+	if(first > count) first = count;
+
+	memcpy(items, (const unsigned char *)data + start * item_size, first * item_size);
+	memcpy((unsigned char *)items + first * item_size, data, (count - first) * item_size);
+	*head += count;
+	return count;
+}
+
 #ifdef __cplusplus
 }
 #endif //__cplusplus
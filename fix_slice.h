@@ -1,26 +1,77 @@
 /* fix_slice.h
 * License: Public Domain or BSD0
-* 
+*
 * To use this library, just include the header
 * All functions are just macros
 * #include "fix_slice.h"
 *
 * Slices for C-Arrays
 *
+* A slice is a view into memory someone else owns, subslicing never copies anything.
+*
+* `fix_slice_strided(T)` also has a stride, counted in elements of T, so it can view every Nth element of an array,
+* or one field across an array of structs (as long as the struct's size is a multiple of `sizeof(T)`).
+*
+* `fix_slice_split` cuts a slice into N pieces whose lengths differ by at most one, and `fix_slice_chunk` into pieces of
+* a fixed length (the last one may be shorter), handy for handing one piece to each worker thread.
+*
+* Define FIX_SLICE_DEBUG to check indices and subslice ranges against the slice's length with FIX_SLICE_ASSERT
+* (default `assert`). Element access has to go through `fix_slice_at` / `fix_slice_strided_at` to be checked.
+*
 * Example Usage:
 * int arr[3] = {1, 2 ,3};
 * fix_slice(int) my_slice;
 * fix_slice_init(my_slice, arr, 3);
-*/ 
+*
+* fix_mat4 transforms[64];
+* fix_slice_strided(float) x; //The x translation of every matrix
+* fix_slice_strided_init(x, &transforms[0].m[12], 64, 16);
+* fix_slice_strided(float) mine;
+* fix_slice_strided_split(mine, x, worker_index, worker_count);
+* for(unsigned int i = 0; i < mine.len; ++i) fix_slice_strided_at(mine, i) += dx;
+*/
 
 #ifndef FIX_SLICE_H
 #define FIX_SLICE_H
 
+#ifdef FIX_SLICE_DEBUG
+#ifndef FIX_SLICE_ASSERT
+#include <assert.h>
+#define FIX_SLICE_ASSERT assert
+#endif //FIX_SLICE_ASSERT
+#define FIX_SLICE_CHECK(cond, msg) FIX_SLICE_ASSERT((cond) && msg)
+#else
+#define FIX_SLICE_CHECK(cond, msg) ((void)0)
+#endif //FIX_SLICE_DEBUG
+
+//Where piece `_i` of `_n` nearly equal pieces of `_len` elements starts
+#define FIX_SLICE_SPLIT_AT(_len, _i, _n) ((unsigned int)((unsigned long long)(_len) * (_i) / (_n)))
+
 #define fix_slice(T) struct { unsigned int len; T *data; }
 #define fix_slice_init(_slice, _start, _l) { _slice.data = _start; _slice.len = _l; }
-#define fix_slice_init_start_end(_slice, arr, _start, _end) { _slice.data = arr[_start]; _slice.len = _end - _start; }
-#define fix_slice_subslice_len(_subslice, _slice, _start, _l) { _subslice.data = _slice.data[_start]; _subslice.len = _l; }
-#define fix_slice_subslice_start_end(_subslice, _slice, _start, _end) { _subslice.data = _slice.data[_start]; _subslice.len = _end - _start;}
+#define fix_slice_init_start_end(_slice, arr, _start, _end) { FIX_SLICE_CHECK((_start) <= (_end), "fix_slice: start past end"); _slice.data = &arr[_start]; _slice.len = (_end) - (_start); }
+#define fix_slice_subslice_len(_subslice, _slice, _start, _l) { FIX_SLICE_CHECK((_start) <= _slice.len && (_l) <= _slice.len - (_start), "fix_slice: subslice out of bounds"); _subslice.data = &_slice.data[_start]; _subslice.len = _l; }
+#define fix_slice_subslice_start_end(_subslice, _slice, _start, _end) { FIX_SLICE_CHECK((_start) <= (_end) && (_end) <= _slice.len, "fix_slice: subslice out of bounds"); _subslice.data = &_slice.data[_start]; _subslice.len = (_end) - (_start);}
+//The element at `_i`, usable on both sides of an assignment
+#define fix_slice_at(_slice, _i) (*(FIX_SLICE_CHECK((unsigned int)(_i) < _slice.len, "fix_slice: index out of bounds"), &_slice.data[_i]))
+//Piece `_i` of `_n` pieces whose lengths differ by at most one
+#define fix_slice_split(_subslice, _slice, _i, _n) fix_slice_subslice_start_end(_subslice, _slice, FIX_SLICE_SPLIT_AT(_slice.len, (_i), (_n)), FIX_SLICE_SPLIT_AT(_slice.len, (_i) + 1, (_n)))
+#define fix_slice_chunk_count(_slice, _chunk_len) ((_slice.len + (_chunk_len) - 1) / (_chunk_len))
+//Chunk `_i` of `_chunk_len` elements, the last one may be shorter
+#define fix_slice_chunk(_subslice, _slice, _i, _chunk_len) fix_slice_subslice_start_end(_subslice, _slice, (_i) * (_chunk_len), ((_i) + 1) * (_chunk_len) < _slice.len ? ((_i) + 1) * (_chunk_len) : _slice.len)
 
-#endif
+// Strided slices
 
+#define fix_slice_strided(T) struct { unsigned int len; unsigned int stride; T *data; }
+//`_stride` is in elements, 1 means contiguous
+#define fix_slice_strided_init(_slice, _start, _l, _stride) { _slice.data = _start; _slice.len = _l; _slice.stride = _stride; }
+#define fix_slice_strided_from_slice(_strided, _slice) { _strided.data = _slice.data; _strided.len = _slice.len; _strided.stride = 1; }
+#define fix_slice_strided_subslice_len(_subslice, _slice, _start, _l) { FIX_SLICE_CHECK((_start) <= _slice.len && (_l) <= _slice.len - (_start), "fix_slice: subslice out of bounds"); _subslice.data = &_slice.data[(unsigned long long)(_start) * _slice.stride]; _subslice.len = _l; _subslice.stride = _slice.stride; }
+#define fix_slice_strided_subslice_start_end(_subslice, _slice, _start, _end) { FIX_SLICE_CHECK((_start) <= (_end) && (_end) <= _slice.len, "fix_slice: subslice out of bounds"); _subslice.data = &_slice.data[(unsigned long long)(_start) * _slice.stride]; _subslice.len = (_end) - (_start); _subslice.stride = _slice.stride; }
+//Every `_n`th element, starting with the first
+#define fix_slice_strided_every(_subslice, _slice, _n) { _subslice.data = _slice.data; _subslice.len = (_slice.len + (_n) - 1) / (_n); _subslice.stride = _slice.stride * (_n); }
+#define fix_slice_strided_at(_slice, _i) (*(FIX_SLICE_CHECK((unsigned int)(_i) < _slice.len, "fix_slice: index out of bounds"), &_slice.data[(unsigned long long)(_i) * _slice.stride]))
+#define fix_slice_strided_split(_subslice, _slice, _i, _n) fix_slice_strided_subslice_start_end(_subslice, _slice, FIX_SLICE_SPLIT_AT(_slice.len, (_i), (_n)), FIX_SLICE_SPLIT_AT(_slice.len, (_i) + 1, (_n)))
+#define fix_slice_strided_chunk(_subslice, _slice, _i, _chunk_len) fix_slice_strided_subslice_start_end(_subslice, _slice, (_i) * (_chunk_len), ((_i) + 1) * (_chunk_len) < _slice.len ? ((_i) + 1) * (_chunk_len) : _slice.len)
+
+#endif
@@ -0,0 +1,180 @@
+/* fix_spsc.h
+* License: Public Domain or zlib
+*
+* To use this library, remember to define FIX_SPSC_IMPL in ONE C or C++ file:
+* #define FIX_SPSC_IMPL
+* #include "fix_spsc.h"
+*
+* Lock-free single-producer single-consumer ring
+*
+* `fix_spsc` is a ring buffer of pointers, like `fix_ring` from fix_queue.h, but lock-free for exactly one producer thread
+* and one consumer thread. The capacity has to be a power of two and the storage is yours (or comes from a `fix_arena`,
+* if fix_arena.h is included before the implementation).
+* The producer's and the consumer's indices sit FIX_SPSC_CACHE_LINE bytes apart, so they don't fight over a cache line,
+* and each side keeps a cached copy of the other's index, only re-reading the real one when the ring looks full or empty.
+*
+* It needs GCC or Clang for the `__atomic` builtins, which is why it lives in its own header.
+*
+* Example Usage:
+* void *storage[256];
+* fix_spsc q;
+* fix_spsc_init(&q, storage, 256);
+* fix_spsc_enqueue(&q, item); //Producer thread
+* while(fix_spsc_dequeue(&q, &item)) {...} //Consumer thread
+*/
+
+#ifndef FIX_SPSC_H
+#define FIX_SPSC_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif //_cplusplus
+
+#ifndef FIX_SPSC_CACHE_LINE
+#define FIX_SPSC_CACHE_LINE 64
+#endif //FIX_SPSC_CACHE_LINE
+
+struct fix_spsc_s
+{
+	void **items;
+	unsigned int mask;
+	unsigned char pad0[FIX_SPSC_CACHE_LINE];
+	//Only written by the producer
+	unsigned int tail;
+	unsigned int cached_head;
+	unsigned char pad1[FIX_SPSC_CACHE_LINE];
+	//Only written by the consumer
+	unsigned int head;
+	unsigned int cached_tail;
+	unsigned char pad2[FIX_SPSC_CACHE_LINE];
+};
+
+typedef struct fix_spsc_s fix_spsc;
+
+int fix_spsc_init(fix_spsc *q, void **buffer, unsigned int capacity);
+#ifdef FIX_ARENA_H
+int fix_spsc_arena_init(fix_spsc *q, fix_arena *arena, unsigned int capacity);
+#endif //FIX_ARENA_H
+int fix_spsc_enqueue(fix_spsc *q, void *item);
+int fix_spsc_dequeue(fix_spsc *q, void **item);
+unsigned int fix_spsc_enqueue_bulk(fix_spsc *q, void **items, unsigned int count);
+unsigned int fix_spsc_dequeue_bulk(fix_spsc *q, void **items, unsigned int count);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //FIX_SPSC_H
+
+
+#if defined(FIX_SPSC_IMPL) && !defined(FIX_SPSC_IMPL_DONE)
+#define FIX_SPSC_IMPL_DONE
+
+//Needed for memcpy
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif //_cplusplus
+
+// Sets the buffer as the queue's storage. `capacity` has to be a power of two, returns 0 if it isn't.
+// Has to happen before the producer and consumer threads start using the queue.
+int fix_spsc_init(fix_spsc *q, void **buffer, unsigned int capacity)
+{
+	if(capacity == 0 || (capacity & (capacity - 1))) return 0;
+
+	q->items = buffer;
+	q->mask = capacity - 1;
+	q->tail = 0;
+	q->cached_head = 0;
+	q->head = 0;
+	q->cached_tail = 0;
+	return 1;
+}
+
+#ifdef FIX_ARENA_H
+// Allocates the queue's storage from the arena. Returns 0 if the capacity isn't a power of two or the arena is out of memory.
+int fix_spsc_arena_init(fix_spsc *q, fix_arena *arena, unsigned int capacity)
+{
+	if(capacity == 0 || (capacity & (capacity - 1))) return 0;
+
+	void **buffer = fix_arena_push_array(arena, void *, capacity);
+	if(!buffer) return 0;
+
+	return fix_spsc_init(q, buffer, capacity);
+}
+#endif //FIX_ARENA_H
+
+// Producer only. Returns 0 if the queue is full.
+int fix_spsc_enqueue(fix_spsc *q, void *item)
+{
+	unsigned int tail = q->tail;
+	if(tail - q->cached_head > q->mask)
+	{
+		q->cached_head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+		if(tail - q->cached_head > q->mask) return 0;
+	}
+
+	q->items[tail & q->mask] = item;
+	__atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+// Consumer only. Returns 0 if the queue is empty, `item` is left untouched then.
+int fix_spsc_dequeue(fix_spsc *q, void **item)
+{
+	unsigned int head = q->head;
+	if(head == q->cached_tail)
+	{
+		q->cached_tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+		if(head == q->cached_tail) return 0;
+	}
+
+	*item = q->items[head & q->mask];
+	__atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+// Producer only. Enqueues as many of the `count` items as fit, returns how many it did.
+unsigned int fix_spsc_enqueue_bulk(fix_spsc *q, void **items, unsigned int count)
+{
+	unsigned int tail = q->tail;
+	if(count > q->mask + 1 - (tail - q->cached_head)) q->cached_head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+
+	unsigned int space = q->mask + 1 - (tail - q->cached_head);
+	if(count > space) count = space;
+
+	unsigned int start = tail & q->mask;
+	unsigned int first = q->mask + 1 - start;
+	if(first > count) first = count;
+
+	memcpy(&q->items[start], items, first * sizeof(void *));
+	memcpy(&q->items[0], items + first, (count - first) * sizeof(void *));
+	__atomic_store_n(&q->tail, tail + count, __ATOMIC_RELEASE);
+	return count;
+}
+
+// Consumer only. Dequeues up to `count` items into `items`, returns how many it did.
+unsigned int fix_spsc_dequeue_bulk(fix_spsc *q, void **items, unsigned int count)
+{
+	unsigned int head = q->head;
+	if(count > q->cached_tail - head) q->cached_tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+
+	unsigned int available = q->cached_tail - head;
+	if(count > available) count = available;
+
+	unsigned int start = head & q->mask;
+	unsigned int first = q->mask + 1 - start;
+	if(first > count) first = count;
+
+	memcpy(items, &q->items[start], first * sizeof(void *));
+	memcpy(items + first, &q->items[0], (count - first) * sizeof(void *));
+	__atomic_store_n(&q->head, head + count, __ATOMIC_RELEASE);
+	return count;
+}
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //FIX_SPSC_IMPL
@@ -12,6 +12,16 @@
 *
 * Define a custom FIX_STACK_SIZE_MAX during compile-time if you want a bigger or smaller stack size.
 * Define FIX_STACK_ZERO_INIT if you really want to set all pointers to 0x0.
+* `fix_stack_push` returns 0 when the stack is full instead of growing it.
+*
+* `fix_stack_typed(T, N)` is a growable stack that stores the items themselves rather than pointers to them.
+* The first N items live inline in the struct, so small stacks (a DFS that rarely goes deep, a short undo buffer...)
+* never allocate. Past that, the items move to the heap (FIX_STACK_MALLOC / FIX_STACK_FREE), or to a `fix_arena`
+* if the stack was set up with `fix_stack_typed_arena_init` (fix_arena.h has to be included before fix_stack.h wherever
+* that's called). Storage doubles whenever it fills up. It's driven by macros, items are copied by
+* assignment and the bulk versions memcpy. Since `data` may point into the struct itself, don't copy the struct around.
+*
+* For a lock-free stack of objects shared between threads, see fix_lfstack.h, and for a work-stealing deque, fix_wsdeque.h.
 */
 
 #ifndef FIX_STACK_H 
@@ -21,6 +31,9 @@
 extern "C"{
 #endif //_cplusplus
 
+//Needed for size_t
+#include <stddef.h>
+
 #ifndef FIX_STACK_SIZE_MAX
 #define FIX_STACK_SIZE_MAX 100
 #endif //FIX_STACK_SIZE_MAX
@@ -34,6 +47,78 @@ struct fix_stack_s
 typedef struct fix_stack_s fix_stack;
 
 void fix_stack_init(fix_stack *s);
+int fix_stack_push(fix_stack *s, void *newi);
+void *fix_stack_pop(fix_stack *s);
+
+// Typed stack
+// Example Usage:
+// struct node *root;
+// fix_stack_typed(struct node *, 64) todo;
+// fix_stack_typed_init(todo);
+// fix_stack_typed_push(todo, root);
+// while(fix_stack_typed_pop(todo, &n)) {...}
+// fix_stack_typed_destroy(todo);
+
+typedef int (*fix_stack_typed_grow_fn)(void **data, unsigned int *cap, void *inline_items, unsigned int len, size_t item_size, unsigned int min_cap, void *arena);
+
+//`grow` is picked by the init macro, so the arena support is compiled wherever the stack is set up to use it
+#define fix_stack_typed(T, N) struct { T *data; unsigned int len; unsigned int cap; void *arena; fix_stack_typed_grow_fn grow; T inline_items[N]; }
+#define fix_stack_typed_init(s) ((s).data = (s).inline_items, (s).len = 0, (s).cap = (unsigned int)(sizeof((s).inline_items) / sizeof(*(s).inline_items)), (s).arena = 0, (s).grow = fix_stack_typed_grow)
+#ifdef FIX_ARENA_H
+//Spills into `arena` instead of the heap
+#define fix_stack_typed_arena_init(s, a) (fix_stack_typed_init(s), (s).arena = (a), (s).grow = fix_stack_typed_arena_grow)
+#endif //FIX_ARENA_H
+//Frees the spilled storage (if it was on the heap) and empties the stack
+#define fix_stack_typed_destroy(s) (fix_stack_typed_release((s).data, (s).inline_items, (s).arena), fix_stack_typed_init(s))
+#define fix_stack_typed_clear(s) ((s).len = 0)
+#define fix_stack_typed_count(s) ((s).len)
+//Makes room for at least `n` items in total. Evaluates to 0 if out of memory.
+#define fix_stack_typed_reserve(s, n) ((n) <= (s).cap || (s).grow((void **)&(s).data, &(s).cap, (s).inline_items, (s).len, sizeof(*(s).data), (n), (s).arena))
+//Evaluates to 0 if out of memory, the item is dropped then
+#define fix_stack_typed_push(s, item) (fix_stack_typed_reserve((s), (s).len + 1) ? ((s).data[(s).len] = (item), (s).len += 1, 1) : 0)
+//Copies the top item to `*out` and evaluates to 1, or to 0 if the stack is empty
+#define fix_stack_typed_pop(s, out) ((s).len == 0 ? 0 : ((s).len -= 1, *(out) = (s).data[(s).len], 1))
+//Same as pop, but leaves the item on the stack
+#define fix_stack_typed_peek(s, out) ((s).len == 0 ? 0 : (*(out) = (s).data[(s).len - 1], 1))
+//Pushes all `count` items, `items[count - 1]` ends up on top. Evaluates to `count`, or to 0 (pushing nothing) if out of memory.
+#define fix_stack_typed_push_bulk(s, items, count) (fix_stack_typed_reserve((s), (s).len + (count)) ? fix_stack_typed_copy_in((s).data, &(s).len, (items), (count), sizeof(*(s).data)) : 0)
+//Pops up to `count` items into `out`, in the order they were pushed (so the old top ends up last). Evaluates to how many it did.
+#define fix_stack_typed_pop_bulk(s, out, count) fix_stack_typed_copy_out((s).data, &(s).len, (out), (count), sizeof(*(s).data))
+
+int fix_stack_typed_grow(void **data, unsigned int *cap, void *inline_items, unsigned int len, size_t item_size, unsigned int min_cap, void *arena);
+void fix_stack_typed_release(void *data, void *inline_items, void *arena);
+unsigned int fix_stack_typed_copy_in(void *data, unsigned int *len, const void *items, unsigned int count, size_t item_size);
+unsigned int fix_stack_typed_copy_out(const void *data, unsigned int *len, void *out, unsigned int count, size_t item_size);
+
+#ifdef FIX_ARENA_H
+//Same as `fix_stack_typed_grow`, but into the arena
+static inline int fix_stack_typed_arena_grow(void **data, unsigned int *cap, void *inline_items, unsigned int len, size_t item_size, unsigned int min_cap, void *arena)
+{
+	unsigned int new_cap = *cap * 2;
+	if(new_cap < min_cap) new_cap = min_cap;
+
+	//A type's alignment always divides its size, so the lowest set bit is a safe alignment for the items
+	unsigned int align = (unsigned int)(item_size & (0u - item_size));
+	if(align > 64) align = 64;
+
+	void *new_data;
+	if(*data == inline_items)
+	{
+		new_data = fix_arena_malloc_aligned((fix_arena *)arena, (unsigned int)(new_cap * item_size), align);
+		if(!new_data) return 0;
+		FIX_ARENA_MEMCPY(new_data, *data, len * item_size);
+	}
+	else
+	{
+		new_data = fix_arena_realloc_aligned((fix_arena *)arena, *data, (unsigned int)(*cap * item_size), (unsigned int)(new_cap * item_size), align);
+		if(!new_data) return 0;
+	}
+
+	*data = new_data;
+	*cap = new_cap;
+	return 1;
+}
+#endif //FIX_ARENA_H
 
 #ifdef __cplusplus
 }
@@ -42,7 +127,17 @@ void fix_stack_init(fix_stack *s);
 #endif //FIX_STACK_H
 
 
-#ifdef FIX_STACK_IMPL
+#if defined(FIX_STACK_IMPL) && !defined(FIX_STACK_IMPL_DONE)
+#define FIX_STACK_IMPL_DONE
+
+#ifndef FIX_STACK_MALLOC
+#include <stdlib.h>
+#define FIX_STACK_MALLOC malloc
+#define FIX_STACK_FREE free
+#endif //FIX_STACK_MALLOC
+
+//Needed for memcpy
+#include <string.h>
 
 #ifdef __cplusplus
 extern "C"{
@@ -50,7 +145,7 @@ extern "C"{
 
 void fix_stack_init(fix_stack *s)
 {
-	s->itop = 0;
+	s->itop = -1;
 #ifdef FIX_STACK_ZERO_INIT
 	for (int i = 0;i < FIX_STACK_SIZE_MAX; ++i) 
 	{
@@ -59,13 +154,14 @@ void fix_stack_init(fix_stack *s)
 #endif //FIX_STACK_ZERO_INIT
 }
 
-void fix_stack_push(fix_stack *s, void *newi)
+// Returns 0 if the stack is full
+int fix_stack_push(fix_stack *s, void *newi)
 {
-	if(s->itop == FIX_STACK_SIZE_MAX - 1) return;
+	if(s->itop == FIX_STACK_SIZE_MAX - 1) return 0;
 
 	s->itop += 1;
 	s->stack[s->itop] = newi;
-	
+	return 1;
 }
 
 void *fix_stack_pop(fix_stack *s)
@@ -76,6 +172,52 @@ void *fix_stack_pop(fix_stack *s)
 	return element;
 }
 
+// Typed stack
+
+// Used by `fix_stack_typed_reserve` on heap-backed stacks. Moves the items to storage for at least `min_cap`
+// (and at least twice as many) items, out of the inline buffer if that's where they were.
+int fix_stack_typed_grow(void **data, unsigned int *cap, void *inline_items, unsigned int len, size_t item_size, unsigned int min_cap, void *arena)
+{
+	unsigned int new_cap = *cap * 2;
+	if(new_cap < min_cap) new_cap = min_cap;
+
+	(void)arena; //Only there to match `fix_stack_typed_arena_grow`
+
+	void *new_data = FIX_STACK_MALLOC(new_cap * item_size);
+	if(!new_data) return 0;
+
+	memcpy(new_data, *data, len * item_size);
+	if(*data != inline_items) FIX_STACK_FREE(*data);
+
+	*data = new_data;
+	*cap = new_cap;
+	return 1;
+}
+
+// Used by `fix_stack_typed_destroy`. Arena storage goes away with the arena.
+void fix_stack_typed_release(void *data, void *inline_items, void *arena)
+{
+	if(data != inline_items && !arena) FIX_STACK_FREE(data);
+}
+
+// Used by `fix_stack_typed_push_bulk`, the room has been reserved already
+unsigned int fix_stack_typed_copy_in(void *data, unsigned int *len, const void *items, unsigned int count, size_t item_size)
+{
+	memcpy((unsigned char *)data + *len * item_size, items, count * item_size);
+	*len += count;
+	return count;
+}
+
+// Used by `fix_stack_typed_pop_bulk`
+unsigned int fix_stack_typed_copy_out(const void *data, unsigned int *len, void *out, unsigned int count, size_t item_size)
+{
+	if(count > *len) count = *len;
+
+	*len -= count;
+	memcpy(out, (const unsigned char *)data + *len * item_size, count * item_size);
+	return count;
+}
+
 #ifdef __cplusplus
 }
 #endif //__cplusplus
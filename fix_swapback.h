@@ -1,18 +1,338 @@
 /* fix_swapback.h
 * License: BSD0
-* 
+*
 * To use this library, just include the header
 * #include "fix_swapback.h"
 *
 * Fixed-Size Swapback Array
-*/ 
+*
+* Removing an element moves the last one into its place, so removal is O(1) but doesn't keep the order.
+*
+* `fix_swapback_dyn(T)` is the same array with storage that grows on demand (doubling), through FIX_SWAPBACK_REALLOC
+* and FIX_SWAPBACK_FREE (define both to use your own allocator). `append` evaluates to 0 if it runs out of memory.
+*
+* `fix_swapback_soa` keeps every field in its own contiguous column (struct-of-arrays) instead of storing whole structs,
+* so a loop that only touches positions streams through positions and nothing else. Add the columns first, then
+* `append` gives you the index of a new row to fill in, and `remove` swaps the last row in across every column at once.
+* Up to FIX_SWAPBACK_SOA_COLUMNS_MAX columns, each one is allocated separately.
+*
+* Example Usage:
+* fix_swapback_soa particles;
+* fix_swapback_soa_init(&particles);
+* unsigned int pos = fix_swapback_soa_add_column(&particles, sizeof(float) * 2);
+* unsigned int life = fix_swapback_soa_add_column(&particles, sizeof(float));
+* unsigned int i = fix_swapback_soa_append(&particles);
+* fix_swapback_soa_column(&particles, float, life)[i] = 1.0f;
+* for(unsigned int j = 0; j < particles.len; ++j) fix_swapback_soa_column(&particles, float, life)[j] -= dt;
+*
+* `fix_slotmap` is a swapback array that hands out stable handles (a sparse set). The elements stay packed in `dense`
+* for iteration, and a sparse array maps every handle's slot to wherever its element currently sits, so when `remove`
+* moves the last element into the hole, the moved element's handle keeps working. Each slot has a generation counter
+* (odd while the slot is in use), so a handle to a removed element returns NULL instead of whatever replaced it.
+*
+* Example Usage:
+* fix_slotmap entities;
+* fix_slotmap_init_type(&entities, struct entity);
+* fix_slotmap_handle h;
+* struct entity *e = fix_slotmap_insert_type(&entities, struct entity, &h);
+* for(unsigned int j = 0; j < entities.len; ++j) update(&fix_slotmap_data(&entities, struct entity)[j]);
+* fix_slotmap_remove(&entities, h);
+*/
 
 #ifndef FIX_SWAPBACK_H
 #define FIX_SWAPBACK_H
 
+#ifndef FIX_SWAPBACK_REALLOC
+#include <stdlib.h>
+#define FIX_SWAPBACK_REALLOC realloc
+#define FIX_SWAPBACK_FREE free
+#endif //FIX_SWAPBACK_REALLOC
+
+#ifndef FIX_SWAPBACK_SOA_COLUMNS_MAX
+#define FIX_SWAPBACK_SOA_COLUMNS_MAX 16
+#endif //FIX_SWAPBACK_SOA_COLUMNS_MAX
+
+//Needed for memcpy
+#include <string.h>
+
 #define fix_swapback(T, size) struct { unsigned int maxlen; unsigned int len; T data[size]; }
 #define fix_swapback_init(arr, size) {arr.len = 0; arr.maxlen = size;}
 #define fix_swapback_append(arr, new) do{if(arr.len == arr.maxlen) {break;} arr.data[arr.len] = new; arr.len += 1;}while(0)
-#define fix_swapback_remove(arr, idx) do{if(arr.len < idx){break;} arr.data[idx] = arr.data[arr.len - 1]; arr.len -= 1; }while(0)
+#define fix_swapback_remove(arr, idx) do{if((idx) >= arr.len){break;} arr.data[idx] = arr.data[arr.len - 1]; arr.len -= 1; }while(0)
+
+//Grows storage to at least double its capacity and at least `min_cap` elements
+static inline int fix_swapback_grow(void **data, unsigned int *cap, size_t elem_size, unsigned int min_cap)
+{
+	unsigned int new_cap = *cap ? *cap * 2 : 8;
+	if(new_cap < min_cap) new_cap = min_cap;
+
+	void *new_data = FIX_SWAPBACK_REALLOC(*data, new_cap * elem_size);
+	if(!new_data) return 0;
+
+	*data = new_data;
+	*cap = new_cap;
+	return 1;
+}
+
+// Growable swapback array
+
+#define fix_swapback_dyn(T) struct { unsigned int cap; unsigned int len; T *data; }
+#define fix_swapback_dyn_init(arr) {arr.cap = 0; arr.len = 0; arr.data = NULL;}
+#define fix_swapback_dyn_destroy(arr) {FIX_SWAPBACK_FREE(arr.data); arr.cap = 0; arr.len = 0; arr.data = NULL;}
+//Makes room for at least `n` elements in total. Evaluates to 0 if out of memory.
+#define fix_swapback_dyn_reserve(arr, n) ((n) <= arr.cap || fix_swapback_grow((void **)&arr.data, &arr.cap, sizeof(*arr.data), (n)))
+//Evaluates to 0 if out of memory, the element is dropped then
+#define fix_swapback_dyn_append(arr, new) (fix_swapback_dyn_reserve(arr, arr.len + 1) ? (arr.data[arr.len] = (new), arr.len += 1, 1) : 0)
+#define fix_swapback_dyn_remove(arr, idx) do{if((idx) >= arr.len){break;} arr.data[idx] = arr.data[arr.len - 1]; arr.len -= 1; }while(0)
+
+// Struct-of-arrays swapback
+
+struct fix_swapback_soa_s
+{
+	unsigned int len;
+	unsigned int cap;
+	unsigned int column_count;
+	unsigned int sizes[FIX_SWAPBACK_SOA_COLUMNS_MAX]; //Element size of each column, in bytes
+	void *columns[FIX_SWAPBACK_SOA_COLUMNS_MAX];
+};
+typedef struct fix_swapback_soa_s fix_swapback_soa;
+
+//Pointer to the first element of a column, as a `T *`
+#define fix_swapback_soa_column(soa, T, column) ((T *)(soa)->columns[column])
+
+static inline void fix_swapback_soa_init(fix_swapback_soa *soa)
+{
+	soa->len = 0;
+	soa->cap = 0;
+	soa->column_count = 0;
+}
+
+//Frees every column
+static inline void fix_swapback_soa_destroy(fix_swapback_soa *soa)
+{
+	for(unsigned int c = 0; c < soa->column_count; ++c) FIX_SWAPBACK_FREE(soa->columns[c]);
+	fix_swapback_soa_init(soa);
+}
+
+//Adds a column of `elem_size`-byte elements. Only do this while the array is empty.
+//Returns the column's index, or FIX_SWAPBACK_SOA_COLUMNS_MAX if there's no room for another column.
+static inline unsigned int fix_swapback_soa_add_column(fix_swapback_soa *soa, unsigned int elem_size)
+{
+	if(soa->column_count == FIX_SWAPBACK_SOA_COLUMNS_MAX) return FIX_SWAPBACK_SOA_COLUMNS_MAX;
+
+	unsigned int c = soa->column_count;
+	soa->sizes[c] = elem_size;
+	soa->columns[c] = NULL;
+	if(soa->cap)
+	{
+		soa->columns[c] = FIX_SWAPBACK_REALLOC(NULL, (size_t)soa->cap * elem_size);
+		if(!soa->columns[c]) return FIX_SWAPBACK_SOA_COLUMNS_MAX;
+	}
+
+	soa->column_count += 1;
+	return c;
+}
+
+#define fix_swapback_soa_add_column_type(soa, T) fix_swapback_soa_add_column((soa), sizeof(T))
+
+//Makes room for at least `n` rows in total. Returns 0 if out of memory, the columns that did grow keep their new size.
+static inline int fix_swapback_soa_reserve(fix_swapback_soa *soa, unsigned int n)
+{
+	if(n <= soa->cap) return 1;
+
+	unsigned int new_cap = soa->cap ? soa->cap * 2 : 8;
+	if(new_cap < n) new_cap = n;
+
+	for(unsigned int c = 0; c < soa->column_count; ++c)
+	{
+		//Every column shares `cap`, so grow each one from the same old capacity
+		unsigned int cap = soa->cap;
+		if(!fix_swapback_grow(&soa->columns[c], &cap, soa->sizes[c], new_cap)) return 0;
+	}
+
+	soa->cap = new_cap;
+	return 1;
+}
+
+//Adds a row at the end and returns its index, the fields are left uninitialized. Returns `len` unchanged (not a valid row) if out of memory.
+static inline unsigned int fix_swapback_soa_append(fix_swapback_soa *soa)
+{
+	if(!fix_swapback_soa_reserve(soa, soa->len + 1)) return soa->len;
+
+	soa->len += 1;
+	return soa->len - 1;
+}
+
+//Moves the last row into row `idx`, across every column
+static inline void fix_swapback_soa_remove(fix_swapback_soa *soa, unsigned int idx)
+{
+	if(idx >= soa->len) return;
+
+	unsigned int last = soa->len - 1;
+	if(idx != last)
+	{
+		for(unsigned int c = 0; c < soa->column_count; ++c)
+		{
+			unsigned char *column = (unsigned char *)soa->columns[c];
+			unsigned int size = soa->sizes[c];
+			memcpy(column + (size_t)idx * size, column + (size_t)last * size, size);
+		}
+	}
+
+	soa->len = last;
+}
+
+// Slot map
+
+#define FIX_SLOTMAP_NONE 0xFFFFFFFFu
+
+struct fix_slotmap_handle_s
+{
+	unsigned int index;
+	unsigned int generation;
+};
+typedef struct fix_slotmap_handle_s fix_slotmap_handle;
+
+struct fix_slotmap_s
+{
+	unsigned char *dense; //`len` packed elements
+	unsigned int *dense_slots; //Slot of each dense element
+	unsigned int *sparse; //Dense index of each used slot, next free slot of each free one
+	unsigned int *generations; //Odd while the slot is in use
+	unsigned int elem_size;
+	unsigned int len;
+	unsigned int slot_count; //Slots handed out at least once
+	unsigned int cap;
+	unsigned int free_head;
+};
+typedef struct fix_slotmap_s fix_slotmap;
+
+//The packed elements as a `T *`, valid until the next insert or remove
+#define fix_slotmap_data(map, T) ((T *)(map)->dense)
+
+static inline void fix_slotmap_init(fix_slotmap *map, unsigned int elem_size)
+{
+	map->dense = NULL;
+	map->dense_slots = NULL;
+	map->sparse = NULL;
+	map->generations = NULL;
+	map->elem_size = elem_size;
+	map->len = 0;
+	map->slot_count = 0;
+	map->cap = 0;
+	map->free_head = FIX_SLOTMAP_NONE;
+}
+
+#define fix_slotmap_init_type(map, T) fix_slotmap_init((map), sizeof(T))
+
+static inline void fix_slotmap_destroy(fix_slotmap *map)
+{
+	FIX_SWAPBACK_FREE(map->dense);
+	FIX_SWAPBACK_FREE(map->dense_slots);
+	FIX_SWAPBACK_FREE(map->sparse);
+	FIX_SWAPBACK_FREE(map->generations);
+	fix_slotmap_init(map, map->elem_size);
+}
+
+//Removes every element. Outstanding handles become stale.
+static inline void fix_slotmap_clear(fix_slotmap *map)
+{
+	for(unsigned int i = 0; i < map->len; ++i)
+	{
+		unsigned int slot = map->dense_slots[i];
+		map->generations[slot] += 1;
+		map->sparse[slot] = map->free_head;
+		map->free_head = slot;
+	}
+	map->len = 0;
+}
+
+//Adds an element and writes its handle out. Returns the element (uninitialized), or NULL if out of memory.
+static inline void *fix_slotmap_insert(fix_slotmap *map, /* out */ fix_slotmap_handle *handle)
+{
+	unsigned int slot = map->free_head;
+	if(slot != FIX_SLOTMAP_NONE)
+	{
+		map->free_head = map->sparse[slot];
+	}
+	else
+	{
+		//No free slots means every slot is in use, so all four arrays are full together
+		if(map->slot_count == map->cap)
+		{
+			unsigned int new_cap = map->cap ? map->cap * 2 : 8;
+			unsigned int cap;
+			cap = map->cap; if(!fix_swapback_grow((void **)&map->dense, &cap, map->elem_size, new_cap)) return NULL;
+			cap = map->cap; if(!fix_swapback_grow((void **)&map->dense_slots, &cap, sizeof(unsigned int), new_cap)) return NULL;
+			cap = map->cap; if(!fix_swapback_grow((void **)&map->sparse, &cap, sizeof(unsigned int), new_cap)) return NULL;
+			cap = map->cap; if(!fix_swapback_grow((void **)&map->generations, &cap, sizeof(unsigned int), new_cap)) return NULL;
+			map->cap = new_cap;
+		}
+
+		slot = map->slot_count;
+		map->generations[slot] = 0;
+		map->slot_count += 1;
+	}
+
+	map->generations[slot] += 1;
+	map->sparse[slot] = map->len;
+	map->dense_slots[map->len] = slot;
+	map->len += 1;
+
+	handle->index = slot;
+	handle->generation = map->generations[slot];
+	return map->dense + (size_t)(map->len - 1) * map->elem_size;
+}
+
+#define fix_slotmap_insert_type(map, T, handle) ((T *)fix_slotmap_insert((map), (handle)))
+
+//Returns the element behind the handle, NULL if it has been removed since
+static inline void *fix_slotmap_get(fix_slotmap *map, fix_slotmap_handle handle)
+{
+	if(handle.index >= map->slot_count || map->generations[handle.index] != handle.generation || !(handle.generation & 1)) return NULL;
+	return map->dense + (size_t)map->sparse[handle.index] * map->elem_size;
+}
+
+#define fix_slotmap_get_type(map, T, handle) ((T *)fix_slotmap_get((map), (handle)))
+
+//Handle of the element at `dense_index`, for removing elements while iterating
+static inline fix_slotmap_handle fix_slotmap_handle_at(fix_slotmap *map, unsigned int dense_index)
+{
+	fix_slotmap_handle handle;
+	handle.index = map->dense_slots[dense_index];
+	handle.generation = map->generations[handle.index];
+	return handle;
+}
+
+//Removes the element behind the handle, moving the last element into its place. Returns 0 if the handle was stale.
+static inline int fix_slotmap_remove(fix_slotmap *map, fix_slotmap_handle handle)
+{
+	if(!fix_slotmap_get(map, handle)) return 0;
+
+	unsigned int slot = handle.index;
+	unsigned int idx = map->sparse[slot];
+	unsigned int last = map->len - 1;
+	if(idx != last)
+	{
+		memcpy(map->dense + (size_t)idx * map->elem_size, map->dense + (size_t)last * map->elem_size, map->elem_size);
+		unsigned int moved = map->dense_slots[last];
+		map->dense_slots[idx] = moved;
+		map->sparse[moved] = idx;
+	}
+	map->len = last;
+
+	map->generations[slot] += 1;
+	map->sparse[slot] = map->free_head;
+	map->free_head = slot;
+	return 1;
+}
+
+//Removes every element behind `handles`, skipping stale ones (and repeats). Returns how many were removed.
+static inline unsigned int fix_slotmap_remove_batch(fix_slotmap *map, const fix_slotmap_handle *handles, unsigned int count)
+{
+	unsigned int removed = 0;
+	for(unsigned int i = 0; i < count; ++i) removed += fix_slotmap_remove(map, handles[i]);
+	return removed;
+}
 
-#endif //FIX_SWAPBACK
\ No newline at end of file
+#endif //FIX_SWAPBACK
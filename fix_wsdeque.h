@@ -0,0 +1,202 @@
+/* fix_wsdeque.h
+* License: Public Domain or zlib
+*
+* To use this library, remember to define FIX_WSDEQUE_IMPL in ONE C or C++ file:
+* #define FIX_WSDEQUE_IMPL
+* #include "fix_wsdeque.h"
+*
+* Work-stealing deque (Chase-Lev)
+*
+* `fix_wsdeque` is a deque of pointers. Its owner thread pushes and pops at the bottom like a stack,
+* while any number of other threads steal from the top. It's lock-free, and the owner only synchronizes with thieves when
+* the deque is almost empty. The circular storage doubles when it fills up, which is the only time it mallocs
+* (define FIX_WSDEQUE_MALLOC and FIX_WSDEQUE_FREE to use your own). Outgrown storage stays alive until `destroy`, since
+* a thief might still be reading from it.
+*
+* It needs GCC or Clang for the `__atomic` builtins, which is why it lives in its own header.
+*
+* Example Usage:
+* fix_wsdeque d;
+* fix_wsdeque_init(&d, 256);
+* fix_wsdeque_push(&d, task); //Owner thread
+* while(fix_wsdeque_pop(&d, &task)) {...} //Owner thread
+* if(fix_wsdeque_steal(&d, &task)) {...} //Any other thread
+* fix_wsdeque_destroy(&d);
+*/
+
+#ifndef FIX_WSDEQUE_H
+#define FIX_WSDEQUE_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif //_cplusplus
+
+#ifndef FIX_WSDEQUE_CACHE_LINE
+#define FIX_WSDEQUE_CACHE_LINE 64
+#endif //FIX_WSDEQUE_CACHE_LINE
+
+//Storage of a `fix_wsdeque`, the items follow right after it
+struct fix_wsdeque_array_s
+{
+	struct fix_wsdeque_array_s *prev; //Outgrown storage, freed on `destroy`
+	long long mask;
+};
+
+typedef struct fix_wsdeque_array_s fix_wsdeque_array;
+
+struct fix_wsdeque_s
+{
+	long long top; //Thieves take from here
+	unsigned char pad0[FIX_WSDEQUE_CACHE_LINE];
+	long long bottom; //Only written by the owner
+	fix_wsdeque_array *array;
+	unsigned char pad1[FIX_WSDEQUE_CACHE_LINE];
+};
+
+typedef struct fix_wsdeque_s fix_wsdeque;
+
+int fix_wsdeque_init(fix_wsdeque *d, unsigned int capacity);
+void fix_wsdeque_destroy(fix_wsdeque *d);
+int fix_wsdeque_push(fix_wsdeque *d, void *item);
+int fix_wsdeque_pop(fix_wsdeque *d, void **item);
+int fix_wsdeque_steal(fix_wsdeque *d, void **item);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //FIX_WSDEQUE_H
+
+
+#if defined(FIX_WSDEQUE_IMPL) && !defined(FIX_WSDEQUE_IMPL_DONE)
+#define FIX_WSDEQUE_IMPL_DONE
+
+#ifndef FIX_WSDEQUE_MALLOC
+#include <stdlib.h>
+#define FIX_WSDEQUE_MALLOC malloc
+#define FIX_WSDEQUE_FREE free
+#endif //FIX_WSDEQUE_MALLOC
+
+#ifdef __cplusplus
+extern "C"{
+#endif //_cplusplus
+
+static void **fix_wsdeque_items(fix_wsdeque_array *a)
+{
+	return (void **)(a + 1);
+}
+
+static fix_wsdeque_array *fix_wsdeque_array_new(long long capacity)
+{
+	fix_wsdeque_array *a = (fix_wsdeque_array *)FIX_WSDEQUE_MALLOC(sizeof(fix_wsdeque_array) + capacity * sizeof(void *));
+	if(!a) return 0;
+
+	a->prev = 0;
+	a->mask = capacity - 1;
+	return a;
+}
+
+// Sets up an empty deque. `capacity` has to be a power of two, returns 0 if it isn't or malloc fails.
+int fix_wsdeque_init(fix_wsdeque *d, unsigned int capacity)
+{
+	if(capacity == 0 || (capacity & (capacity - 1))) return 0;
+
+	d->array = fix_wsdeque_array_new(capacity);
+	d->top = 0;
+	d->bottom = 0;
+	return d->array != 0;
+}
+
+// Frees the storage, including any outgrown arrays. No thread can be using the deque anymore.
+void fix_wsdeque_destroy(fix_wsdeque *d)
+{
+	fix_wsdeque_array *a = d->array;
+	while(a)
+	{
+		fix_wsdeque_array *prev = a->prev;
+		FIX_WSDEQUE_FREE(a);
+		a = prev;
+	}
+
+	d->array = 0;
+	d->top = 0;
+	d->bottom = 0;
+}
+
+// Owner only. Returns 0 if the deque was full and growing it failed.
+int fix_wsdeque_push(fix_wsdeque *d, void *item)
+{
+	long long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+	long long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+	fix_wsdeque_array *a = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+
+	if(b - t > a->mask)
+	{
+		fix_wsdeque_array *grown = fix_wsdeque_array_new((a->mask + 1) * 2);
+		if(!grown) return 0;
+
+		for(long long i = t; i < b; ++i)
+		{
+			void *moved = __atomic_load_n(&fix_wsdeque_items(a)[i & a->mask], __ATOMIC_RELAXED);
+			__atomic_store_n(&fix_wsdeque_items(grown)[i & grown->mask], moved, __ATOMIC_RELAXED);
+		}
+		grown->prev = a;
+		__atomic_store_n(&d->array, grown, __ATOMIC_RELEASE);
+		a = grown;
+	}
+
+	__atomic_store_n(&fix_wsdeque_items(a)[b & a->mask], item, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+	return 1;
+}
+
+// Owner only. Takes the most recently pushed item, returns 0 if the deque is empty.
+int fix_wsdeque_pop(fix_wsdeque *d, void **item)
+{
+	long long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+	fix_wsdeque_array *a = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+	__atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	long long t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+
+	if(t > b)
+	{
+		__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	void *x = __atomic_load_n(&fix_wsdeque_items(a)[b & a->mask], __ATOMIC_RELAXED);
+	if(t == b)
+	{
+		//Last item, race the thieves for it
+		int won = __atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+		__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+		if(!won) return 0;
+	}
+
+	*item = x;
+	return 1;
+}
+
+// Any thread. Takes the oldest item, returns 0 if the deque is empty or another thread took it first.
+int fix_wsdeque_steal(fix_wsdeque *d, void **item)
+{
+	long long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	long long b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+	if(t >= b) return 0;
+
+	fix_wsdeque_array *a = __atomic_load_n(&d->array, __ATOMIC_ACQUIRE);
+	void *x = __atomic_load_n(&fix_wsdeque_items(a)[t & a->mask], __ATOMIC_RELAXED);
+	if(!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) return 0;
+
+	*item = x;
+	return 1;
+}
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //FIX_WSDEQUE_IMPL